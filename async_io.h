@@ -0,0 +1,517 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define SIMPLE_THREADPOOL_IO_URING 1
+#endif
+
+// Asynchronous file reads and writes whose completions run as pool jobs, so
+// workers hand I/O to the kernel instead of stalling in pread/pwrite.
+//
+// On Linux it drives an io_uring directly (no liburing needed): submitters
+// fill submission entries under a short lock and one io_uring_enter() pushes
+// them, optionally many at once through a Batch; a reaper thread sleeps in
+// io_uring_enter(GETEVENTS) and turns every completion into a job on the
+// pool. Buffers registered with register_buffers() can be used by
+// read_fixed/write_fixed, which skips the kernel's per-op page pinning.
+//
+// Where io_uring is missing or refused (old kernel, seccomp, non-Linux), the
+// same calls run pread/pwrite on a small helper pool instead and then post
+// the callback to the main pool, so callers never see the difference.
+//
+// Callbacks get the syscall's result: bytes transferred, or -errno. Every
+// operation gets exactly one: queued past any queue bound, or run in place if
+// the pool has shut down. Buffers and fds must stay valid until the callback
+// runs. At most `entries` (times two, the completion ring size) operations
+// are in flight; beyond that a submitter waits for one to finish. A length
+// over UINT32_MAX fails with -EINVAL, and if the kernel keeps refusing a
+// submission the refused operations fail with its -errno.
+class AsyncIo {
+public:
+    enum class Backend { IoUring, Threads };
+
+    struct Options {
+        unsigned entries = 256;       // submission ring size (power of two)
+        size_t fallbackThreads = 4;   // helper threads when io_uring is unavailable
+        bool forceFallback = false;   // use the helper threads even if io_uring works
+        SimpleThreadPool::Priority priority = SimpleThreadPool::Priority::Normal;   // of completion jobs
+    };
+
+    explicit AsyncIo(SimpleThreadPool& pool) : AsyncIo(pool, Options{}) {}
+
+    AsyncIo(SimpleThreadPool& pool, const Options& opts) : pool_(pool), opts_(opts) {
+#ifdef SIMPLE_THREADPOOL_IO_URING
+        if (!opts_.forceFallback && setupRing()) {
+            reaper_ = std::thread([this] { reapLoop(); });
+            return;
+        }
+#endif
+        helpers_.reset(new SimpleThreadPool(opts_.fallbackThreads ? opts_.fallbackThreads : 1));
+    }
+
+    AsyncIo(const AsyncIo&) = delete;
+    AsyncIo& operator=(const AsyncIo&) = delete;
+
+    // Waits for every operation in flight to complete (their callbacks are
+    // queued on the pool, not necessarily run).
+    ~AsyncIo() {
+#ifdef SIMPLE_THREADPOOL_IO_URING
+        if (ringFd_ >= 0) {
+            {
+                std::unique_lock<std::mutex> lk(m_);
+                opFree_.wait(lk, [&] { return freeOps_.size() == opCount_; });
+                // Nothing is in flight, so a refusal can only be transient.
+                for (;;) {
+                    io_uring_sqe* sqe = nextSqe();
+                    std::memset(sqe, 0, sizeof(*sqe));
+                    sqe->opcode = IORING_OP_NOP;
+                    sqe->user_data = kStop;
+                    if (flushLocked()) break;
+                    lk.unlock();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    lk.lock();
+                }
+            }
+            reaper_.join();
+            teardownRing();
+            return;
+        }
+#endif
+        helpers_->shutdown();
+    }
+
+    Backend backend() const { return helpers_ ? Backend::Threads : Backend::IoUring; }
+
+    template <typename F>
+    void read(int fd, void* buf, size_t len, uint64_t offset, F&& cb) {
+        Batch b(*this);
+        b.read(fd, buf, len, offset, std::forward<F>(cb));
+    }
+
+    template <typename F>
+    void write(int fd, const void* buf, size_t len, uint64_t offset, F&& cb) {
+        Batch b(*this);
+        b.write(fd, buf, len, offset, std::forward<F>(cb));
+    }
+
+    // Pins `buffers` for read_fixed/write_fixed, which name them by index.
+    // Once per AsyncIo; returns false if the kernel refused (e.g. over
+    // RLIMIT_MEMLOCK), in which case the fixed calls fall back to plain ones.
+    bool register_buffers(const std::vector<iovec>& buffers) {
+#ifdef SIMPLE_THREADPOOL_IO_URING
+        if (ringFd_ >= 0 && !buffers.empty()) {
+            std::lock_guard<std::mutex> lk(m_);
+            fixedOk_ = syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_BUFFERS, buffers.data(),
+                               static_cast<unsigned>(buffers.size())) == 0;
+            return fixedOk_;
+        }
+#endif
+        (void)buffers;
+        return false;
+    }
+
+    // `buf` must lie inside registered buffer `index`.
+    template <typename F>
+    void read_fixed(int fd, unsigned index, void* buf, size_t len, uint64_t offset, F&& cb) {
+        Batch b(*this);
+        b.read_fixed(fd, index, buf, len, offset, std::forward<F>(cb));
+    }
+
+    template <typename F>
+    void write_fixed(int fd, unsigned index, const void* buf, size_t len, uint64_t offset, F&& cb) {
+        Batch b(*this);
+        b.write_fixed(fd, index, buf, len, offset, std::forward<F>(cb));
+    }
+
+    // Stages several operations and submits them with one io_uring_enter()
+    // when it goes out of scope (or on submit()). Holds the submission lock
+    // meanwhile, so keep it short and do not wait on completions inside it.
+    class Batch {
+    public:
+        explicit Batch(AsyncIo& io) : io_(io) {
+#ifdef SIMPLE_THREADPOOL_IO_URING
+            if (io_.ringFd_ >= 0) lk_ = std::unique_lock<std::mutex>(io_.m_);
+#endif
+        }
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+        ~Batch() {
+            submit();
+#ifdef SIMPLE_THREADPOOL_IO_URING
+            // Refused ops are answered only now, with the lock released, so
+            // a callback that runs in place may start I/O of its own.
+            if (lk_.owns_lock() && !io_.failed_.empty()) io_.postFailed(lk_);
+#endif
+        }
+
+        template <typename F>
+        void read(int fd, void* buf, size_t len, uint64_t offset, F&& cb) {
+            io_.stage(lk_, Kind::Read, fd, buf, len, offset, 0, std::forward<F>(cb));
+        }
+
+        template <typename F>
+        void write(int fd, const void* buf, size_t len, uint64_t offset, F&& cb) {
+            io_.stage(lk_, Kind::Write, fd, const_cast<void*>(buf), len, offset, 0, std::forward<F>(cb));
+        }
+
+        template <typename F>
+        void read_fixed(int fd, unsigned index, void* buf, size_t len, uint64_t offset, F&& cb) {
+            io_.stage(lk_, Kind::ReadFixed, fd, buf, len, offset, index, std::forward<F>(cb));
+        }
+
+        template <typename F>
+        void write_fixed(int fd, unsigned index, const void* buf, size_t len, uint64_t offset, F&& cb) {
+            io_.stage(lk_, Kind::WriteFixed, fd, const_cast<void*>(buf), len, offset, index, std::forward<F>(cb));
+        }
+
+        void submit() {
+#ifdef SIMPLE_THREADPOOL_IO_URING
+            if (lk_.owns_lock()) io_.flushLocked();
+#endif
+        }
+
+    private:
+        AsyncIo& io_;
+        std::unique_lock<std::mutex> lk_;
+    };
+
+private:
+    enum class Kind { Read, Write, ReadFixed, WriteFixed };
+
+    // Without a ring: the helper thread does the syscall, then the callback
+    // goes to the main pool like an io_uring completion would.
+    template <typename F>
+    void stage(std::unique_lock<std::mutex>& lk, Kind kind, int fd, void* buf, size_t len, uint64_t offset,
+               unsigned index, F&& cb) {
+#ifdef SIMPLE_THREADPOOL_IO_URING
+        if (ringFd_ >= 0) {
+            stageRing(lk, kind, fd, buf, len, offset, index, std::forward<F>(cb));
+            return;
+        }
+#endif
+        (void)lk;
+        (void)index;
+        if (len > UINT32_MAX) {
+            post(std::decay_t<F>(std::forward<F>(cb)), -EINVAL);
+            return;
+        }
+        helpers_->submit([this, kind, fd, buf, len, offset, cb = std::decay_t<F>(std::forward<F>(cb))]() mutable {
+            ssize_t r = (kind == Kind::Read || kind == Kind::ReadFixed)
+                            ? ::pread(fd, buf, len, static_cast<off_t>(offset))
+                            : ::pwrite(fd, buf, len, static_cast<off_t>(offset));
+            int64_t res = r < 0 ? -errno : r;
+            post(std::move(cb), res);
+        });
+    }
+
+    // Delivers a result as a pool job. If the pool destroys the job unrun
+    // (it shut down, or DropOldest evicted it) the callback runs right there
+    // instead, so a completion is never lost.
+    template <typename Fn>
+    struct Completion {
+        Fn cb;
+        int64_t res;
+        bool pending = true;
+
+        Completion(Fn&& f, int64_t r) : cb(std::move(f)), res(r) {}
+        Completion(Completion&& o) noexcept(std::is_nothrow_move_constructible_v<Fn>)
+            : cb(std::move(o.cb)), res(o.res), pending(o.pending) {
+            o.pending = false;
+        }
+        Completion& operator=(Completion&&) = delete;
+
+        void operator()() {
+            pending = false;
+            cb(res);
+        }
+        ~Completion() {
+            if (pending) cb(res);
+        }
+    };
+
+    // Queued over any capacity bound, like a timer firing: the reaper must
+    // not block on a full queue, and a refused completion would be lost.
+    template <typename Fn>
+    void post(Fn&& cb, int64_t res) {
+        pool_.submitUnbounded(Completion<Fn>(std::move(cb), res), opts_.priority);
+    }
+
+    SimpleThreadPool& pool_;
+    Options opts_;
+    std::unique_ptr<SimpleThreadPool> helpers_;   // fallback backend only
+
+#ifdef SIMPLE_THREADPOOL_IO_URING
+    // One in-flight operation: its callback, stored inline when small.
+    // `finish` moves the callback out into a completion job together with
+    // the result, leaving the slot free. It is stored last with release so
+    // the reaper, which learns of the op from the kernel rather than from
+    // us, sees the callback too.
+    struct Op {
+        static constexpr size_t kInline = 48;   // plus the result, still fits a Task inline
+        alignas(std::max_align_t) unsigned char buf[kInline];
+        std::atomic<Task (*)(Op&, int64_t res)> finish{nullptr};
+    };
+
+    template <typename Fn>
+    static constexpr bool fitsOp() {
+        return sizeof(Fn) <= Op::kInline && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template <typename Fn>
+    static Task finishOp(Op& op, int64_t res) {
+        if constexpr (fitsOp<Fn>()) {
+            Fn* fn = std::launder(reinterpret_cast<Fn*>(op.buf));
+            Task job(Completion<Fn>(std::move(*fn), res));
+            fn->~Fn();
+            return job;
+        } else {
+            std::unique_ptr<Fn> fn(*reinterpret_cast<Fn**>(op.buf));
+            return Task(Completion<Fn>(std::move(*fn), res));
+        }
+    }
+
+    template <typename F>
+    void stageRing(std::unique_lock<std::mutex>& lk, Kind kind, int fd, void* buf, size_t len, uint64_t offset,
+                   unsigned index, F&& cb) {
+        using Fn = std::decay_t<F>;
+        if (len > UINT32_MAX) {   // sqe->len is 32 bits
+            failed_.emplace_back(Completion<Fn>(Fn(std::forward<F>(cb)), -EINVAL));
+            return;
+        }
+        if ((kind == Kind::ReadFixed || kind == Kind::WriteFixed) && !fixedOk_) {
+            kind = kind == Kind::ReadFixed ? Kind::Read : Kind::Write;
+        }
+        if (freeOps_.empty()) {
+            flushLocked();   // whatever is staged must go in before we sleep
+            ++opWaiters_;
+            opFree_.wait(lk, [&] { return !freeOps_.empty(); });
+            --opWaiters_;
+        }
+        uint32_t id = freeOps_.back();
+        freeOps_.pop_back();
+        Op& op = ops_[id];
+        if constexpr (fitsOp<Fn>()) {
+            new (op.buf) Fn(std::forward<F>(cb));
+        } else {
+            *reinterpret_cast<Fn**>(op.buf) = new Fn(std::forward<F>(cb));
+        }
+        op.finish.store(&finishOp<Fn>, std::memory_order_release);
+
+        io_uring_sqe* sqe = nextSqe();
+        std::memset(sqe, 0, sizeof(*sqe));
+        switch (kind) {
+        case Kind::Read: sqe->opcode = IORING_OP_READ; break;
+        case Kind::Write: sqe->opcode = IORING_OP_WRITE; break;
+        case Kind::ReadFixed: sqe->opcode = IORING_OP_READ_FIXED; break;
+        case Kind::WriteFixed: sqe->opcode = IORING_OP_WRITE_FIXED; break;
+        }
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buf);
+        sqe->len = static_cast<uint32_t>(len);
+        sqe->off = offset;
+        sqe->buf_index = static_cast<uint16_t>(index);
+        sqe->user_data = id;
+    }
+
+    static std::atomic<unsigned>& ringWord(void* base, unsigned off) {
+        return *reinterpret_cast<std::atomic<unsigned>*>(static_cast<char*>(base) + off);
+    }
+
+    bool setupRing() {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, opts_.entries, &p));
+        if (fd < 0) return false;
+        ringFd_ = fd;
+
+        sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cqRing_ = single ? sqRing_
+                         : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+        sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqRing_ == MAP_FAILED || cqRing_ == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED) munmap(sqes, sqesSize_);
+            if (sqRing_ == MAP_FAILED) sqRing_ = nullptr;
+            if (cqRing_ == MAP_FAILED) cqRing_ = nullptr;
+            teardownRing();
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        sqHead_ = &ringWord(sqRing_, p.sq_off.head);
+        sqTail_ = &ringWord(sqRing_, p.sq_off.tail);
+        sqMask_ = ringWord(sqRing_, p.sq_off.ring_mask).load(std::memory_order_relaxed);
+        sqEntries_ = p.sq_entries;
+        sqArray_ = reinterpret_cast<unsigned*>(static_cast<char*>(sqRing_) + p.sq_off.array);
+        cqHead_ = &ringWord(cqRing_, p.cq_off.head);
+        cqTail_ = &ringWord(cqRing_, p.cq_off.tail);
+        cqMask_ = ringWord(cqRing_, p.cq_off.ring_mask).load(std::memory_order_relaxed);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cqRing_) + p.cq_off.cqes);
+        sqLocalTail_ = sqTail_->load(std::memory_order_relaxed);
+
+        // Never more in flight than the completion ring holds, so it cannot overflow.
+        ops_.reset(new Op[p.cq_entries]);
+        opCount_ = p.cq_entries;
+        freeOps_.reserve(p.cq_entries);
+        for (uint32_t i = p.cq_entries; i-- > 0;) freeOps_.push_back(i);
+        return true;
+    }
+
+    void teardownRing() {
+        if (sqes_) munmap(sqes_, sqesSize_);
+        if (cqRing_ && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+        if (sqRing_) munmap(sqRing_, sqRingSize_);
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+
+    // Under m_. A full submission ring is pushed to the kernel first.
+    io_uring_sqe* nextSqe() {
+        if (sqLocalTail_ - sqHead_->load(std::memory_order_acquire) == sqEntries_) flushLocked();
+        unsigned idx = sqLocalTail_ & sqMask_;
+        sqArray_[idx] = idx;
+        ++sqLocalTail_;
+        return &sqes_[idx];
+    }
+
+    // Under m_: publishes the staged entries and submits them in one syscall.
+    // EAGAIN and EBUSY mean the kernel is short of memory or still holds
+    // completions: back off, giving the reaper time to drain the completion
+    // ring, and retry a bounded number of times. Past that, or on any other
+    // error, the entries still staged fail with -errno. Returns false then.
+    bool flushLocked() {
+        sqTail_->store(sqLocalTail_, std::memory_order_release);
+        for (int tries = 0;;) {
+            unsigned left = sqLocalTail_ - sqHead_->load(std::memory_order_acquire);
+            if (left == 0) return true;
+            long n = syscall(__NR_io_uring_enter, ringFd_, left, 0, 0, nullptr, 0);
+            if (n >= 0 || errno == EINTR) continue;
+            int err = errno;
+            if ((err == EAGAIN || err == EBUSY) && ++tries < kSubmitTries) {
+                if (cqHead_->load(std::memory_order_acquire) != cqTail_->load(std::memory_order_acquire)) {
+                    std::this_thread::yield();   // the reaper has work that frees room
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                continue;
+            }
+            failStagedLocked(-err);
+            return false;
+        }
+    }
+
+    // Under m_. Without SQPOLL the kernel reads the submission ring only
+    // inside io_uring_enter, and every such call that submits holds m_, so
+    // the entries it has not consumed can be taken back. Their callbacks
+    // become completion jobs now; postFailed() queues them once m_ is free.
+    void failStagedLocked(int64_t res) {
+        unsigned head = sqHead_->load(std::memory_order_acquire);
+        sqTail_->store(head, std::memory_order_release);
+        for (unsigned t = head; t != sqLocalTail_; ++t) {
+            uint64_t data = sqes_[sqArray_[t & sqMask_]].user_data;
+            if (data == kStop) continue;   // the destructor stages it again
+            uint32_t id = static_cast<uint32_t>(data);
+            failed_.push_back(ops_[id].finish.load(std::memory_order_relaxed)(ops_[id], res));
+            freeOps_.push_back(id);
+        }
+        sqLocalTail_ = head;
+        if (opWaiters_ || freeOps_.size() == opCount_) opFree_.notify_all();
+    }
+
+    // Releases m_ first: a refused completion runs in place and may submit.
+    void postFailed(std::unique_lock<std::mutex>& lk) {
+        std::vector<Task> failed;
+        failed.swap(failed_);
+        lk.unlock();
+        for (Task& job : failed) pool_.submitUnbounded(std::move(job), opts_.priority);
+    }
+
+    void reapLoop() {
+        std::vector<uint32_t> done;
+        done.reserve(opCount_);
+        for (;;) {
+            syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            bool stop = false;
+            unsigned head = cqHead_->load(std::memory_order_relaxed);
+            unsigned tail = cqTail_->load(std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes_[head & cqMask_];
+                if (cqe.user_data == kStop) {
+                    stop = true;
+                    continue;
+                }
+                uint32_t id = static_cast<uint32_t>(cqe.user_data);
+                pool_.submitUnbounded(ops_[id].finish.load(std::memory_order_acquire)(ops_[id], cqe.res),
+                                      opts_.priority);
+                done.push_back(id);
+            }
+            cqHead_->store(head, std::memory_order_release);
+            if (!done.empty()) {
+                std::lock_guard<std::mutex> lk(m_);
+                freeOps_.insert(freeOps_.end(), done.begin(), done.end());
+                if (opWaiters_ || freeOps_.size() == opCount_) opFree_.notify_all();
+                done.clear();
+            }
+            if (stop) return;
+        }
+    }
+
+    static constexpr uint64_t kStop = ~uint64_t(0);
+    static constexpr int kSubmitTries = 100;   // at most about 10ms of backoff
+
+    int ringFd_ = -1;
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    size_t sqRingSize_ = 0, cqRingSize_ = 0, sqesSize_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    std::atomic<unsigned>* sqHead_ = nullptr;
+    std::atomic<unsigned>* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0, sqEntries_ = 0;
+    std::atomic<unsigned>* cqHead_ = nullptr;
+    std::atomic<unsigned>* cqTail_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned cqMask_ = 0;
+    std::thread reaper_;
+
+    // Submission side; everything below is under m_.
+    std::mutex m_;
+    std::condition_variable opFree_;
+    unsigned sqLocalTail_ = 0;   // our tail, ahead of sqTail_ by the staged entries
+    std::unique_ptr<Op[]> ops_;
+    size_t opCount_ = 0;
+    std::vector<uint32_t> freeOps_;
+    int opWaiters_ = 0;
+    bool fixedOk_ = false;
+    std::vector<Task> failed_;   // refused ops' completion jobs, posted by postFailed()
+#endif
+};
@@ -0,0 +1,291 @@
+// Random 4 KiB reads: blocking pread on pool workers vs AsyncIo.
+// Build: g++ -std=c++17 -O2 -pthread async_io_bench.cpp -o async_io_bench
+// Usage: ./async_io_bench [file MiB, default 256] [reads, default 100000]
+// Uses O_DIRECT when the filesystem allows it; otherwise the file sits in the
+// page cache after the first pass and every mode measures syscall overhead.
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "async_io.h"
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t kBlock = 4096;
+static constexpr size_t kDepth = 64;   // reads in flight for the async modes
+static constexpr size_t kGroup = 8;    // slots resubmitted together by the batched mode
+
+static uint64_t blockOffset(size_t i, size_t blocks) {
+    uint64_t x = (i + 1) * 0x9E3779B97F4A7C15ull;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 29;
+    return (x % blocks) * kBlock;
+}
+
+// Counts completions and wakes the main thread after the last one. The
+// flag is set under the lock so wait() cannot return, and the caller free
+// this, while the last completer is still inside one().
+struct Done {
+    std::atomic<size_t> left;
+    std::atomic<size_t> failed{0};
+    std::mutex m;
+    std::condition_variable cv;
+    bool finished = false;
+
+    explicit Done(size_t n) : left(n) {}
+
+    void one(int64_t res) {
+        if (res != static_cast<int64_t>(kBlock)) failed.fetch_add(1, std::memory_order_relaxed);
+        if (left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lk(m);
+            finished = true;
+            cv.notify_all();
+        }
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&] { return finished; });
+    }
+    bool waitFor(std::chrono::seconds limit) {
+        std::unique_lock<std::mutex> lk(m);
+        return cv.wait_for(lk, limit, [&] { return finished; });
+    }
+};
+
+static void row(const char* name, size_t reads, double ms, size_t failed) {
+    std::cout << std::setw(26) << name << std::fixed << std::setprecision(0) << std::setw(12)
+              << reads / (ms / 1000.0) << std::setprecision(2) << std::setw(12) << ms * 1000.0 / reads
+              << (failed ? "   FAILED " + std::to_string(failed) : "") << "\n";
+}
+
+// Each job blocks its worker in pread for the whole read.
+static double blockingReads(SimpleThreadPool& pool, int fd, size_t reads, size_t blocks, size_t& failed) {
+    Done done(reads);
+    auto t0 = Clock::now();
+    for (size_t i = 0; i < reads; ++i) {
+        pool.submit([&, i] {
+            static thread_local std::unique_ptr<void, decltype(&std::free)> buf(std::aligned_alloc(kBlock, kBlock),
+                                                                               &std::free);
+            done.one(::pread(fd, buf.get(), kBlock, static_cast<off_t>(blockOffset(i, blocks))));
+        });
+    }
+    done.wait();
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    failed = done.failed.load();
+    return ms;
+}
+
+// kDepth slots, each reissuing its next read from its completion callback.
+struct AsyncRun {
+    AsyncIo& io;
+    int fd;
+    size_t reads, blocks;
+    unsigned char* bufs;
+    bool fixed;
+    Done done;
+    std::atomic<size_t> next{0};
+
+    AsyncRun(AsyncIo& io_, int fd_, size_t reads_, size_t blocks_, unsigned char* bufs_, bool fixed_)
+        : io(io_), fd(fd_), reads(reads_), blocks(blocks_), bufs(bufs_), fixed(fixed_), done(reads_) {}
+
+    void issue(AsyncIo::Batch& b, size_t slot) {
+        size_t i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= reads) return;
+        unsigned char* buf = bufs + slot * kBlock;
+        auto cb = [this, slot](int64_t res) { completed(slot, res); };
+        if (fixed) {
+            b.read_fixed(fd, 0, buf, kBlock, blockOffset(i, blocks), cb);
+        } else {
+            b.read(fd, buf, kBlock, blockOffset(i, blocks), cb);
+        }
+    }
+
+    // Plain mode refills one slot per completion; fixed mode waits for its
+    // group of kGroup slots and refills them with one submission. The read
+    // is counted last, once this run is no longer touched.
+    std::atomic<size_t> groupLeft[kDepth / kGroup];
+
+    void completed(size_t slot, int64_t res) {
+        if (!fixed) {
+            AsyncIo::Batch b(io);
+            issue(b, slot);
+        } else if (groupLeft[slot / kGroup].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            size_t g = slot / kGroup;
+            groupLeft[g].store(kGroup, std::memory_order_relaxed);
+            AsyncIo::Batch b(io);
+            for (size_t s = g * kGroup; s < (g + 1) * kGroup; ++s) issue(b, s);
+        }
+        done.one(res);
+    }
+
+    double run() {
+        for (auto& g : groupLeft) g.store(kGroup, std::memory_order_relaxed);
+        auto t0 = Clock::now();
+        {
+            AsyncIo::Batch b(io);
+            for (size_t s = 0; s < kDepth; ++s) issue(b, s);
+        }
+        done.wait();
+        return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    }
+};
+
+// A length the 32-bit sqe->len cannot hold must fail, not wrap to a short read.
+static bool checkOversized(SimpleThreadPool& pool, int fd, bool fallback) {
+    AsyncIo::Options o;
+    o.forceFallback = fallback;
+    AsyncIo io(pool, o);
+    Done done(1);
+    std::atomic<int64_t> got{0};
+    static unsigned char byte;
+    io.read(fd, &byte, size_t(UINT32_MAX) + 2, 0, [&](int64_t res) {
+        got.store(res);
+        done.one(res);
+    });
+    done.wait();
+    bool ok = got.load() == -EINVAL;
+    std::cout << "oversized " << (fallback ? "helper" : "ring") << " read: " << got.load() << (ok ? " (ok)" : " (FAIL)")
+              << "\n";
+    return ok;
+}
+
+// Completions go to the pool past any queue bound, and run in place once it
+// has shut down, so a pool that refuses submits never loses a callback. A
+// lost one cannot be unwound, so it is reported and the process exits.
+static void waitOrDie(Done& done, const char* what) {
+    if (!done.waitFor(std::chrono::seconds(5))) {
+        std::cout << "completions on " << what << ": " << done.left.load() << " lost (FAIL)" << std::endl;
+        std::_Exit(1);
+    }
+}
+
+static bool checkRefusingPools(int fd, bool fallback) {
+    const size_t reads = 64;
+    std::unique_ptr<unsigned char, decltype(&std::free)> buf(
+        static_cast<unsigned char*>(std::aligned_alloc(kBlock, reads * kBlock)), &std::free);   // for O_DIRECT
+    AsyncIo::Options o;
+    o.forceFallback = fallback;
+
+    SimpleThreadPool::Options po;
+    po.threads = 1;
+    po.queueCapacity = 2;
+    po.overflow = SimpleThreadPool::Overflow::Reject;
+    SimpleThreadPool full(po);
+    std::atomic<bool> release{false};
+    full.submit([&] {
+        while (!release.load()) std::this_thread::yield();
+    });
+    Done fullDone(reads);
+    {
+        AsyncIo io(full, o);
+        for (size_t i = 0; i < reads; ++i) {
+            io.read(fd, buf.get() + i * kBlock, kBlock, i * kBlock, [&](int64_t res) { fullDone.one(res); });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        release = true;
+        waitOrDie(fullDone, "a full Reject pool");
+    }
+
+    SimpleThreadPool stopped(1);
+    stopped.shutdown();
+    Done stoppedDone(reads);
+    {
+        AsyncIo io(stopped, o);
+        for (size_t i = 0; i < reads; ++i) {
+            io.read(fd, buf.get() + i * kBlock, kBlock, i * kBlock, [&](int64_t res) { stoppedDone.one(res); });
+        }
+        waitOrDie(stoppedDone, "a shut-down pool");
+    }
+    size_t failed = fullDone.failed.load() + stoppedDone.failed.load();
+    std::cout << "completions on a full and a shut-down pool (" << (fallback ? "helper" : "ring")
+              << "): " << 2 * reads - failed << " / " << 2 * reads << (failed ? " (FAIL)" : " (ok)") << "\n";
+    return failed == 0;
+}
+
+int main(int argc, char** argv) {
+    size_t mib = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 256;
+    size_t reads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+    size_t blocks = mib * 1024 * 1024 / kBlock;
+    // Fixed mode refills whole groups, so round to a multiple of them.
+    reads = (reads + kGroup - 1) / kGroup * kGroup;
+    const char* path = "async_io_bench.dat";
+
+    {
+        int wfd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (wfd < 0) {
+            std::perror("open");
+            return 1;
+        }
+        std::vector<unsigned char> chunk(1 << 20);
+        for (size_t i = 0; i < chunk.size(); ++i) chunk[i] = static_cast<unsigned char>(i * 131);
+        for (size_t m = 0; m < mib; ++m) {
+            if (::write(wfd, chunk.data(), chunk.size()) != static_cast<ssize_t>(chunk.size())) {
+                std::perror("write");
+                return 1;
+            }
+        }
+        ::fsync(wfd);
+        ::close(wfd);
+    }
+    bool direct = true;
+    int fd = ::open(path, O_RDONLY | O_DIRECT);
+    if (fd < 0) {
+        direct = false;
+        fd = ::open(path, O_RDONLY);
+    }
+
+    unsigned char* bufs = static_cast<unsigned char*>(std::aligned_alloc(kBlock, kDepth * kBlock));
+    SimpleThreadPool pool(4);
+    if (!checkOversized(pool, fd, false) || !checkOversized(pool, fd, true) || !checkRefusingPools(fd, false) ||
+        !checkRefusingPools(fd, true)) {
+        return 1;
+    }
+    std::cout << mib << " MiB file, " << reads << " random 4 KiB reads, "
+              << (direct ? "O_DIRECT" : "buffered (page cache)") << ", 4 workers, depth " << kDepth << "\n";
+    std::cout << std::setw(26) << "mode" << std::setw(12) << "reads/s" << std::setw(12) << "us/read" << "\n";
+
+    size_t failed = 0;
+    double ms = blockingReads(pool, fd, reads, blocks, failed);
+    row("blocking pread", reads, ms, failed);
+
+    {
+        AsyncIo io(pool);
+        if (io.backend() == AsyncIo::Backend::IoUring) {
+            AsyncRun plain(io, fd, reads, blocks, bufs, false);
+            row("io_uring", reads, plain.run(), plain.done.failed.load());
+
+            bool registered = io.register_buffers({iovec{bufs, kDepth * kBlock}});
+            AsyncRun fixed(io, fd, reads, blocks, bufs, true);
+            row(registered ? "io_uring fixed+batched" : "io_uring batched", reads, fixed.run(),
+                fixed.done.failed.load());
+        } else {
+            std::cout << "io_uring unavailable\n";
+        }
+    }
+    {
+        AsyncIo::Options o;
+        o.forceFallback = true;
+        AsyncIo io(pool, o);
+        AsyncRun helpers(io, fd, reads, blocks, bufs, false);
+        row("helper threads", reads, helpers.run(), helpers.done.failed.load());
+    }
+
+    pool.wait_idle();
+    std::free(bufs);
+    ::close(fd);
+    ::unlink(path);
+    return 0;
+}
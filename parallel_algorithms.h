@@ -0,0 +1,280 @@
+#pragma once
+
+// Parallel versions of the usual loops over a random-access range, run on a
+// SimpleThreadPool:
+//
+//   double sum = parallel_reduce(pool, v.begin(), v.end(), 0.0, std::plus<>());
+//   parallel_inclusive_scan(pool, v.begin(), v.end(), out.begin(), std::plus<>());
+//   parallel_transform(pool, a.begin(), a.end(), b.begin(), [](double x) { return x * 2; });
+//   parallel_sort(pool, v.begin(), v.end());
+//
+// Each call splits the range into a few chunks per worker and hands them to
+// pool.parallel_for, so the calling thread works too and idle workers pick up
+// whatever chunks are left. Ranges under kSequentialCutoff elements just run
+// the std:: algorithm on the calling thread. Like the std:: parallel
+// overloads, reduce and scan may regroup the operands, so `op` must be
+// associative (and for reduce, commutative).
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "threadpool.h"
+
+namespace detail {
+
+// Below this many elements the pool round-trip costs more than it saves.
+constexpr size_t kSequentialCutoff = 1 << 15;
+
+// A per-chunk result on its own cache line, so chunks finishing side by side
+// do not ping-pong a shared line.
+template <typename T>
+struct alignas(64) PaddedSlot {
+    T value;
+};
+
+// Enough chunks that a slow worker does not hold everyone up (4 per thread,
+// counting the caller), but none smaller than minChunk.
+inline size_t chunkCount(const SimpleThreadPool& pool, size_t n, size_t minChunk) {
+    size_t byWork = (n + minChunk - 1) / minChunk;
+    return std::max<size_t>(1, std::min(byWork, 4 * (pool.size() + 1)));
+}
+
+// [lo, hi) of chunk c when n elements are split into k nearly equal chunks.
+inline std::pair<size_t, size_t> chunkBounds(size_t n, size_t k, size_t c) {
+    return {n * c / k, n * (c + 1) / k};
+}
+
+// Sequential fold of [first, first + n) (n >= 1) into 8 independent
+// accumulators of type T, so the loop has no single dependency chain and the
+// compiler can keep them in vector registers.
+template <typename T, typename It, typename Op>
+T reduceChunk(It first, size_t n, Op& op) {
+    constexpr size_t kLanes = 8;
+    if (n < 2 * kLanes) {
+        T acc = first[0];
+        for (size_t i = 1; i < n; ++i) acc = op(acc, first[i]);
+        return acc;
+    }
+    T lanes[kLanes];
+    for (size_t j = 0; j < kLanes; ++j) lanes[j] = first[j];
+    size_t i = kLanes;
+    for (; i + kLanes <= n; i += kLanes) {
+        for (size_t j = 0; j < kLanes; ++j) lanes[j] = op(lanes[j], first[i + j]);
+    }
+    for (; i < n; ++i) lanes[0] = op(lanes[0], first[i]);
+    T acc = lanes[0];
+    for (size_t j = 1; j < kLanes; ++j) acc = op(acc, lanes[j]);
+    return acc;
+}
+
+} // namespace detail
+
+// Folds [first, last) into init with op, accumulating in T as
+// std::accumulate does. op must be associative and
+// commutative; the grouping depends on the chunking, so floating-point sums
+// can differ from std::accumulate in the last bits.
+template <typename It, typename T, typename Op>
+T parallel_reduce(SimpleThreadPool& pool, It first, It last, T init, Op op) {
+    size_t n = static_cast<size_t>(std::distance(first, last));
+    if (n == 0) return init;
+    if (n < detail::kSequentialCutoff) return op(init, detail::reduceChunk<T>(first, n, op));
+
+    size_t k = detail::chunkCount(pool, n, detail::kSequentialCutoff / 4);
+    std::unique_ptr<detail::PaddedSlot<T>[]> partial(new detail::PaddedSlot<T>[k]);
+    pool.parallel_for(size_t(0), k, size_t(1), [&](size_t c) {
+        auto [lo, hi] = detail::chunkBounds(n, k, c);
+        partial[c].value = detail::reduceChunk<T>(first + lo, hi - lo, op);
+    });
+    for (size_t c = 0; c < k; ++c) init = op(init, partial[c].value);
+    return init;
+}
+
+// out[i] = op(first[i]) for every i; or the two-range form, out[i] =
+// op(first1[i], first2[i]). `out` may be `first` itself.
+template <typename It, typename Out, typename Op>
+Out parallel_transform(SimpleThreadPool& pool, It first, It last, Out out, Op op) {
+    size_t n = static_cast<size_t>(std::distance(first, last));
+    if (n < detail::kSequentialCutoff) return std::transform(first, last, out, op);
+
+    size_t k = detail::chunkCount(pool, n, detail::kSequentialCutoff / 4);
+    pool.parallel_for(size_t(0), k, size_t(1), [&](size_t c) {
+        auto [lo, hi] = detail::chunkBounds(n, k, c);
+        It in = first + lo;
+        Out o = out + lo;
+        for (size_t i = 0; i < hi - lo; ++i) o[i] = op(in[i]);
+    });
+    return out + n;
+}
+
+template <typename It1, typename It2, typename Out, typename Op>
+Out parallel_transform(SimpleThreadPool& pool, It1 first1, It1 last1, It2 first2, Out out, Op op) {
+    size_t n = static_cast<size_t>(std::distance(first1, last1));
+    if (n < detail::kSequentialCutoff) return std::transform(first1, last1, first2, out, op);
+
+    size_t k = detail::chunkCount(pool, n, detail::kSequentialCutoff / 4);
+    pool.parallel_for(size_t(0), k, size_t(1), [&](size_t c) {
+        auto [lo, hi] = detail::chunkBounds(n, k, c);
+        It1 a = first1 + lo;
+        It2 b = first2 + lo;
+        Out o = out + lo;
+        for (size_t i = 0; i < hi - lo; ++i) o[i] = op(a[i], b[i]);
+    });
+    return out + n;
+}
+
+// out[i] = first[0] op ... op first[i]. `out` may be `first` itself.
+// Reduce-then-scan: each chunk is summed, the chunk sums are scanned on the
+// calling thread, then every chunk scans itself starting from its offset. The
+// input is read twice and the output written once.
+template <typename It, typename Out, typename Op>
+Out parallel_inclusive_scan(SimpleThreadPool& pool, It first, It last, Out out, Op op) {
+    size_t n = static_cast<size_t>(std::distance(first, last));
+    if (n < detail::kSequentialCutoff) return std::inclusive_scan(first, last, out, op);
+
+    using V = typename std::iterator_traits<It>::value_type;
+    size_t k = detail::chunkCount(pool, n, detail::kSequentialCutoff / 4);
+    std::unique_ptr<detail::PaddedSlot<V>[]> carry(new detail::PaddedSlot<V>[k]);
+
+    // The last chunk's sum is never needed.
+    pool.parallel_for(size_t(0), k - 1, size_t(1), [&](size_t c) {
+        auto [lo, hi] = detail::chunkBounds(n, k, c);
+        carry[c].value = detail::reduceChunk<V>(first + lo, hi - lo, op);
+    });
+    for (size_t c = 1; c + 1 < k; ++c) carry[c].value = op(carry[c - 1].value, carry[c].value);
+
+    pool.parallel_for(size_t(0), k, size_t(1), [&](size_t c) {
+        auto [lo, hi] = detail::chunkBounds(n, k, c);
+        It in = first + lo;
+        Out o = out + lo;
+        V acc = c == 0 ? in[0] : op(carry[c - 1].value, in[0]);
+        o[0] = acc;
+        for (size_t i = 1; i < hi - lo; ++i) {
+            acc = op(acc, in[i]);
+            o[i] = acc;
+        }
+    });
+    return out + n;
+}
+
+namespace detail {
+
+// Sample sort. Splitters taken from a sorted random sample cut the range into
+// buckets; each chunk counts (then scatters) its elements per bucket into a
+// scratch buffer, every bucket is sorted on its own, and the buckets move
+// back in order. Keys equal to a splitter get a bucket of their own that is
+// already sorted, so heavy duplicates do not end up in one giant bucket.
+template <typename It, typename Comp>
+void sampleSort(SimpleThreadPool& pool, It first, size_t n, Comp comp) {
+    using T = typename std::iterator_traits<It>::value_type;
+    constexpr size_t kOversample = 16;
+    constexpr int kMaxLevels = 7;   // 127 splitters: 2 * 127 + 1 buckets fit a uint8_t
+
+    // 2^levels - 1 splitters, so they form a complete search tree.
+    int levels = 1;
+    while (levels < kMaxLevels && (size_t(2) << levels) * (kSequentialCutoff / 2) <= n) ++levels;
+    size_t splitters = (size_t(1) << levels) - 1;
+    size_t buckets = 2 * splitters + 1;
+
+    // Even buckets hold keys strictly between two splitters; odd bucket 2i+1
+    // holds keys equal to splitter i.
+    std::vector<T> sample;
+    sample.reserve(kOversample * (splitters + 1));
+    uint64_t rng = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < kOversample * (splitters + 1); ++i) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        sample.push_back(first[rng % n]);
+    }
+    std::sort(sample.begin(), sample.end(), comp);
+    std::vector<T> split;
+    split.reserve(splitters);
+    for (size_t i = 1; i <= splitters; ++i) split.push_back(sample[i * kOversample]);
+
+    // Splitters in breadth-first (Eytzinger) order: finding a key's bucket is
+    // `levels` branch-free steps down the tree instead of a binary search
+    // with a hard-to-predict branch per step.
+    std::vector<T> tree(splitters + 1);
+    size_t next = 0;
+    auto fill = [&](auto& self, size_t node) -> void {
+        if (node > splitters) return;
+        self(self, 2 * node);
+        tree[node] = split[next++];
+        self(self, 2 * node + 1);
+    };
+    fill(fill, 1);
+
+    auto classify = [&](const T& x) -> uint8_t {
+        size_t j = 1;
+        for (int l = 0; l < levels; ++l) j = 2 * j + !comp(x, tree[j]);
+        size_t i = j - (splitters + 1);   // splitters <= x
+        return static_cast<uint8_t>(i > 0 && !comp(split[i - 1], x) ? 2 * i - 1 : 2 * i);
+    };
+
+    // Pass 1: bucket of every element (kept, so pass 2 does not search again)
+    // and per-chunk bucket counts.
+    size_t k = chunkCount(pool, n, kSequentialCutoff / 4);
+    std::unique_ptr<uint8_t[]> bucketOf(new uint8_t[n]);
+    std::vector<size_t> counts(k * buckets, 0);   // chunk-major; rows far apart
+    pool.parallel_for(size_t(0), k, size_t(1), [&](size_t c) {
+        auto [lo, hi] = chunkBounds(n, k, c);
+        size_t* row = &counts[c * buckets];
+        for (size_t i = lo; i < hi; ++i) {
+            uint8_t b = classify(first[i]);
+            bucketOf[i] = b;
+            ++row[b];
+        }
+    });
+
+    // Bucket-major offsets: all of bucket 0 (chunk 0, chunk 1, ...), then bucket 1...
+    std::vector<size_t> bucketStart(buckets + 1, 0);
+    size_t pos = 0;
+    for (size_t b = 0; b < buckets; ++b) {
+        bucketStart[b] = pos;
+        for (size_t c = 0; c < k; ++c) {
+            size_t cnt = counts[c * buckets + b];
+            counts[c * buckets + b] = pos;
+            pos += cnt;
+        }
+    }
+    bucketStart[buckets] = n;
+
+    // Pass 2: scatter into scratch; each chunk owns disjoint output ranges.
+    std::unique_ptr<T[]> scratch(new T[n]);
+    pool.parallel_for(size_t(0), k, size_t(1), [&](size_t c) {
+        auto [lo, hi] = chunkBounds(n, k, c);
+        size_t* next = &counts[c * buckets];
+        for (size_t i = lo; i < hi; ++i) scratch[next[bucketOf[i]]++] = std::move(first[i]);
+    });
+
+    // Sort each bucket and move it back. Buckets are claimed dynamically, so
+    // a big one just keeps one thread busy while the others take the rest.
+    pool.parallel_for(size_t(0), buckets, size_t(1), [&](size_t b) {
+        T* lo = scratch.get() + bucketStart[b];
+        T* hi = scratch.get() + bucketStart[b + 1];
+        if (b % 2 == 0) std::sort(lo, hi, comp);
+        std::move(lo, hi, first + bucketStart[b]);
+    });
+}
+
+} // namespace detail
+
+// Sorts [first, last) with comp (not stable). Needs n extra elements of
+// scratch plus one byte per element; value_type must be default
+// constructible.
+template <typename It, typename Comp = std::less<>>
+void parallel_sort(SimpleThreadPool& pool, It first, It last, Comp comp = Comp()) {
+    size_t n = static_cast<size_t>(std::distance(first, last));
+    if (n < 2 * detail::kSequentialCutoff) {
+        std::sort(first, last, comp);
+        return;
+    }
+    detail::sampleSort(pool, first, n, comp);
+}
@@ -0,0 +1,98 @@
+// Parallel algorithms vs their sequential std:: counterparts.
+// Build: g++ -std=c++17 -O3 -march=native -pthread parallel_algorithms_bench.cpp -o parallel_algorithms_bench
+// Usage: ./parallel_algorithms_bench [elements, default 100000000]
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+#include "parallel_algorithms.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Best of a few runs, in milliseconds.
+template <typename Body>
+static double bestMs(int runs, Body&& body) {
+    double best = 1e300;
+    for (int r = 0; r < runs; ++r) {
+        auto t0 = Clock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+    }
+    return best;
+}
+
+static void row(const char* name, double seq, double par, bool ok) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1) << std::setw(12) << seq
+              << std::setw(12) << par << std::setw(10) << std::setprecision(2) << seq / par << "x"
+              << (ok ? "" : "   MISMATCH") << "\n";
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000;
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    // The calling thread takes chunks too, so one worker fewer than cores.
+    SimpleThreadPool pool(std::max(1u, hw - 1));
+    std::cout << n << " elements, " << hw << " hardware threads\n";
+    std::cout << std::setw(12) << "algorithm" << std::setw(12) << "std:: ms" << std::setw(12) << "pool ms"
+              << std::setw(11) << "speedup" << "\n";
+
+    // Inputs are scoped per test so 100M elements fit in a few GB.
+    std::vector<int64_t> ints(n);
+    uint64_t rng = 88172645463325252ull;
+    for (size_t i = 0; i < n; ++i) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        ints[i] = static_cast<int64_t>(rng % 1000);
+    }
+
+    {
+        int64_t a = 0, b = 0;
+        double seq = bestMs(3, [&] { a = std::accumulate(ints.begin(), ints.end(), int64_t(0)); });
+        double par = bestMs(3, [&] { b = parallel_reduce(pool, ints.begin(), ints.end(), int64_t(0), std::plus<>()); });
+        row("reduce i64", seq, par, a == b);
+    }
+    {
+        std::vector<double> xs(n), ys(n), ref(n);
+        for (size_t i = 0; i < n; ++i) xs[i] = static_cast<double>(ints[i]) * 1e-3 + static_cast<double>(i % 13);
+
+        double a = 0, b = 0;
+        double seq = bestMs(3, [&] { a = std::accumulate(xs.begin(), xs.end(), 0.0); });
+        double par = bestMs(3, [&] { b = parallel_reduce(pool, xs.begin(), xs.end(), 0.0, std::plus<>()); });
+        row("reduce f64", seq, par, std::abs(a - b) <= 1e-9 * std::abs(a));
+
+        auto op = [](double x) { return x * 1.5 + 2.0; };
+        seq = bestMs(3, [&] { std::transform(xs.begin(), xs.end(), ref.begin(), op); });
+        par = bestMs(3, [&] { parallel_transform(pool, xs.begin(), xs.end(), ys.begin(), op); });
+        row("transform", seq, par, ref == ys);
+    }
+    {
+        std::vector<int64_t> a(n), b(n);
+        double seq = bestMs(3, [&] { std::inclusive_scan(ints.begin(), ints.end(), a.begin()); });
+        double par = bestMs(3, [&] { parallel_inclusive_scan(pool, ints.begin(), ints.end(), b.begin(), std::plus<>()); });
+        row("scan i64", seq, par, a == b);
+    }
+    {
+        // Wide key range, then a heavy-duplicate one (only 1000 distinct keys).
+        std::vector<int64_t> a(n), b;
+        for (size_t i = 0; i < n; ++i) a[i] = ints[i] * 1000003 + static_cast<int64_t>(i % 7919);
+        b = a;
+        double seq = bestMs(1, [&] { std::sort(a.begin(), a.end()); });
+        double par = bestMs(1, [&] { parallel_sort(pool, b.begin(), b.end()); });
+        row("sort i64", seq, par, a == b);
+
+        a = ints;
+        b = ints;
+        seq = bestMs(1, [&] { std::sort(a.begin(), a.end()); });
+        par = bestMs(1, [&] { parallel_sort(pool, b.begin(), b.end()); });
+        row("sort dups", seq, par, a == b);
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Build: g++ -std=c++20 -O2 -pthread pool_coro.cpp -o pool_coro
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include "pool_coro.h"
+
+// Pretend backend lookup: hops onto a worker, then "waits" for a reply.
+task<int> lookup(SimpleThreadPool& pool, int key) {
+    co_await pool.schedule();
+    co_return key * 10;
+}
+
+// A request handler written as straight-line code; no OS thread blocks on the
+// awaited lookups.
+task<int> handle(SimpleThreadPool& pool, int request) {
+    co_await pool.schedule();
+    int a = co_await lookup(pool, request);
+    int b = co_await lookup(pool, request + 1);
+    co_return a + b;
+}
+
+// Completes synchronously; awaiting a long chain of these must not grow the stack.
+task<long> one() { co_return 1; }
+
+task<long> countUp(long n) {
+    long sum = 0;
+    for (long i = 0; i < n; ++i) sum += co_await one();
+    co_return sum;
+}
+
+// schedule() must resume the coroutine even where submit() would refuse the
+// job (a full Reject queue, a shut-down pool); a dropped resume left
+// sync_wait() blocked forever. A hang cannot be unwound, so it is reported
+// and the process exits. `release` frees a worker held busy meanwhile.
+static bool checkScheduleRefused(const char* name, SimpleThreadPool& pool, std::atomic<bool>* release) {
+    std::atomic<int> result{-1};
+    std::thread waiter([&] { result = sync_wait(lookup(pool, 7)); });
+    if (release) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        *release = true;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (result.load() < 0 && std::chrono::steady_clock::now() < deadline) std::this_thread::yield();
+    if (result.load() < 0) {
+        std::cout << name << "hung (FAIL)" << std::endl;
+        std::_Exit(1);
+    }
+    waiter.join();
+    std::cout << name << result.load() << (result.load() == 70 ? " (ok)" : " (FAIL)") << "\n";
+    return result.load() == 70;
+}
+
+// ---------------- Demo ----------------
+int main() {
+    SimpleThreadPool pool(4);
+
+    std::cout << "handle(1) = " << sync_wait(handle(pool, 1)) << "\n";
+
+    // Many concurrent handlers on 4 threads.
+    std::atomic<int> finished{0};
+    std::atomic<long> total{0};
+    const int requests = 10000;
+    for (int r = 0; r < requests; ++r) {
+        co_spawn(pool, [](SimpleThreadPool& p, int r, std::atomic<int>& fin, std::atomic<long>& tot) -> task<void> {
+            tot += co_await handle(p, r);
+            ++fin;
+        }(pool, r, finished, total));
+    }
+    while (finished.load() < requests) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::cout << requests << " handlers done, total = " << total << "\n";
+
+    std::cout << "1M synchronous awaits: " << sync_wait(countUp(1000000)) << "\n";
+
+    SimpleThreadPool::Options opts;
+    opts.threads = 1;
+    opts.queueCapacity = 1;
+    opts.overflow = SimpleThreadPool::Overflow::Reject;
+    SimpleThreadPool full(opts);
+    std::atomic<bool> release{false};
+    full.submit([&] {
+        while (!release.load()) std::this_thread::yield();
+    });
+    while (!full.submit([] {})) std::this_thread::yield();   // the worker took the blocker; fill its place
+    SimpleThreadPool stopped(1);
+    stopped.shutdown();
+    if (!checkScheduleRefused("schedule() on a full Reject queue: ", full, &release) ||
+        !checkScheduleRefused("schedule() after shutdown: ", stopped, nullptr)) {
+        return 1;
+    }
+    return 0;
+}
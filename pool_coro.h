@@ -0,0 +1,275 @@
+#pragma once
+
+// C++20 coroutines on SimpleThreadPool:
+//
+//   task<int> fetch(SimpleThreadPool& pool) {
+//       co_await pool.schedule();      // hop onto a worker
+//       int a = co_await parse(pool);  // await another task, no thread blocked
+//       co_return a + 1;
+//   }
+//
+// task<T> is lazy: it starts when awaited (or via sync_wait / co_spawn). Finishing
+// a task transfers straight into its awaiter (symmetric transfer), so long
+// chains of synchronously-completing awaits do not grow the stack (this relies
+// on the compiler turning the transfer into a tail call, which GCC and Clang
+// do when optimizing; -O0 and sanitizer builds may still recurse). Coroutine
+// frames come from a per-thread size-class freelist, which on pool workers
+// means a per-worker one.
+//
+// Build with -std=c++20.
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <new>
+#include <cstddef>
+
+#include "threadpool.h"
+
+#ifndef SIMPLE_THREADPOOL_COROUTINES
+#error "pool_coro.h needs C++20 coroutine support"
+#endif
+
+namespace detail {
+
+// Size-class freelist for coroutine frames, one per thread. Frames freed on a
+// different thread than they were allocated on simply join that thread's list.
+class FrameAllocator {
+public:
+    static void* allocate(size_t n) {
+        size_t c = sizeClass(n);
+        if (c >= kClasses) return ::operator new(n);
+        Cache& cache = local();
+        if (Block* b = cache.heads[c]) {
+            cache.heads[c] = b->next;
+            --cache.counts[c];
+            return b;
+        }
+        return ::operator new((c + 1) * kGranule);
+    }
+
+    static void deallocate(void* p, size_t n) {
+        size_t c = sizeClass(n);
+        if (c >= kClasses) {
+            ::operator delete(p);
+            return;
+        }
+        Cache& cache = local();
+        if (cache.counts[c] >= kMaxCached) {
+            ::operator delete(p);
+            return;
+        }
+        Block* b = static_cast<Block*>(p);
+        b->next = cache.heads[c];
+        cache.heads[c] = b;
+        ++cache.counts[c];
+    }
+
+private:
+    static constexpr size_t kGranule = 64;
+    static constexpr size_t kClasses = 16;      // frames up to 1 KiB are pooled
+    static constexpr size_t kMaxCached = 1024;  // per class, per thread
+
+    struct Block {
+        Block* next;
+    };
+
+    struct Cache {
+        Block* heads[kClasses] = {};
+        size_t counts[kClasses] = {};
+        ~Cache() {
+            for (Block*& head : heads) {
+                while (head) {
+                    Block* next = head->next;
+                    ::operator delete(head);
+                    head = next;
+                }
+            }
+        }
+    };
+
+    static size_t sizeClass(size_t n) { return n == 0 ? 0 : (n - 1) / kGranule; }
+
+    static Cache& local() {
+        static thread_local Cache cache;
+        return cache;
+    }
+};
+
+// Mixed into every promise type so frames use FrameAllocator.
+struct PooledFrame {
+    static void* operator new(size_t n) { return FrameAllocator::allocate(n); }
+    static void operator delete(void* p, size_t n) { FrameAllocator::deallocate(p, n); }
+};
+
+// Fire-and-forget coroutine: starts eagerly and frees its own frame at the end.
+struct DetachedTask {
+    struct promise_type : PooledFrame {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+template <typename T = void>
+class task;
+
+namespace detail {
+
+template <typename T>
+struct TaskPromiseBase : PooledFrame {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Resume whoever awaited us directly instead of returning to a scheduler
+    // loop; with nobody waiting, just stop.
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            auto next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase<T> {
+    std::optional<T> value;
+
+    task<T> get_return_object() noexcept;
+    template <typename U>
+    void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+
+    T result() {
+        if (this->error) std::rethrow_exception(this->error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase<void> {
+    task<void> get_return_object() noexcept;
+    void return_void() noexcept {}
+
+    void result() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace detail
+
+// Lazy, move-only coroutine result. Await it exactly once.
+template <typename T>
+class task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task() = default;
+    explicit task(handle_type h) noexcept : h_(h) {}
+    task(task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    task& operator=(task&& o) noexcept {
+        if (this != &o) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(o.h_, {});
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    ~task() {
+        if (h_) h_.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            handle_type h;
+            bool await_ready() const noexcept { return !h || h.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+                h.promise().continuation = caller;
+                return h;  // start the child right here (symmetric transfer)
+            }
+            T await_resume() { return h.promise().result(); }
+        };
+        return Awaiter{h_};
+    }
+
+private:
+    handle_type h_;
+};
+
+namespace detail {
+
+template <typename T>
+task<T> TaskPromise<T>::get_return_object() noexcept {
+    return task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline task<void> TaskPromise<void>::get_return_object() noexcept {
+    return task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+template <typename T>
+struct SyncWaitState {
+    std::mutex m;
+    std::condition_variable cv;
+    bool done = false;
+    std::optional<std::conditional_t<std::is_void_v<T>, char, T>> value;
+    std::exception_ptr error;
+};
+
+template <typename T>
+DetachedTask syncWaitRunner(task<T>& t, SyncWaitState<T>& st) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(t);
+            st.value.emplace();
+        } else {
+            st.value.emplace(co_await std::move(t));
+        }
+    } catch (...) {
+        st.error = std::current_exception();
+    }
+    // Notify under the lock: the waiter owns `st` and may return as soon as it sees done.
+    std::lock_guard<std::mutex> lk(st.m);
+    st.done = true;
+    st.cv.notify_one();
+}
+
+inline DetachedTask spawnRunner(SimpleThreadPool& pool, task<void> t) {
+    co_await pool.schedule();
+    co_await std::move(t);
+}
+
+} // namespace detail
+
+// Blocks a (non-worker) thread until `t` finishes and returns its result.
+template <typename T>
+T sync_wait(task<T> t) {
+    detail::SyncWaitState<T> st;
+    detail::syncWaitRunner(t, st);
+    std::unique_lock<std::mutex> lk(st.m);
+    st.cv.wait(lk, [&] { return st.done; });
+    if (st.error) std::rethrow_exception(st.error);
+    if constexpr (!std::is_void_v<T>) return std::move(*st.value);
+}
+
+// Starts `t` on a pool worker and forgets about it. Exceptions terminate.
+inline void co_spawn(SimpleThreadPool& pool, task<void> t) {
+    detail::spawnRunner(pool, std::move(t));
+}
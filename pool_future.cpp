@@ -0,0 +1,55 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#include "pool_future.h"
+
+// ---------------- Demo ----------------
+// A request handler that fans out to shards, merges the answers and formats
+// a reply. Written with nested submit_future().get() it needs a free worker
+// per level of nesting and hangs on a one-thread pool; with continuations no
+// job ever waits, so one worker is enough.
+static PoolFuture<long> queryShard(SimpleThreadPool& pool, int shard) {
+    return spawn(pool, [shard] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));   // the lookup
+        return long(shard) * 100;
+    });
+}
+
+int main() {
+    SimpleThreadPool pool(1);
+
+    std::vector<PoolFuture<long>> shards;
+    for (int s = 1; s <= 4; ++s) shards.push_back(queryShard(pool, s));
+
+    auto reply = when_all(std::move(shards))
+                     .then([](std::vector<long> rows) {
+                         long total = 0;
+                         for (long r : rows) total += r;
+                         return total;
+                     })
+                     .then([](long total) { return "total rows: " + std::to_string(total); });
+    std::cout << reply.get() << "\n";
+
+    // Whichever replica answers first wins; the slow one is ignored.
+    std::vector<PoolFuture<std::string>> replicas;
+    replicas.push_back(spawn(pool, [] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return std::string("replica A");
+    }));
+    replicas.push_back(spawn(pool, [] { return std::string("replica B"); }));
+    auto first = when_any(std::move(replicas)).get();
+    std::cout << "first answer from " << first.value << " (#" << first.index << ")\n";
+
+    // A failure skips the rest of the chain and surfaces in get().
+    auto failing = spawn(pool, []() -> int { throw std::runtime_error("shard offline"); })
+                       .then([](int rows) { return rows * 2; });
+    try {
+        failing.get();
+    } catch (const std::exception& e) {
+        std::cout << "chain failed: " << e.what() << "\n";
+    }
+    return 0;
+}
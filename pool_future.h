@@ -0,0 +1,605 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <tuple>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <cstddef>
+
+#include "threadpool.h"
+
+// Futures whose continuations run on the pool instead of a blocked thread:
+//
+//     auto total = spawn(pool, load).then(parse).then(sum);
+//     auto both = when_all(spawn(pool, a), spawn(pool, b));
+//
+// then() queues the next step the moment the previous one finishes, on the
+// worker that finished it when called from one (it lands in that worker's
+// LIFO slot with Options::lifoSlot). No pool thread ever sits in get() waiting for another job, so a
+// chain cannot deadlock a small pool the way nested TaskFuture::get() can.
+//
+// A chain shares one state from spawn() to the last then(): each step takes
+// the previous value out of it and puts its own result back, so a linear
+// chain costs one (pooled) allocation no matter how many links it has. The
+// state comes from a per-thread freelist like TaskFuture's, and values up to
+// 64 bytes are stored inline. when_all/when_any start one new chain and one
+// small join record. then() consumes the future it is called on.
+//
+// An exception skips the remaining then() steps and comes out of get(). A
+// step the pool refuses or drops (shut down, bounded queue) fails the chain
+// with std::future_error(broken_promise), as TaskFuture does.
+
+template <typename T>
+class PoolFuture;
+
+namespace detail {
+
+class ChainState {
+public:
+    using Priority = SimpleThreadPool::Priority;
+
+    // Fresh state with two references: one for the future, one for the producer.
+    static ChainState* acquire(SimpleThreadPool* pool, Priority prio) {
+        FreeList& fl = freeList();
+        ChainState* s = fl.head;
+        if (s) {
+            fl.head = s->nextFree_;
+            --fl.count;
+        } else {
+            s = new ChainState;
+        }
+        s->pool_ = pool;
+        s->prio_ = prio;
+        s->refs_.store(2, std::memory_order_relaxed);
+        return s;
+    }
+
+    void retain() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) recycle();
+    }
+
+    SimpleThreadPool* pool() const { return pool_; }
+    Priority priority() const { return prio_; }
+
+    // Value and error of the current link. Only the producer of the link, or
+    // the step or waiter it was handed to, touches them.
+    template <typename T, typename... Args>
+    void emplace(Args&&... args) {
+        clearValue();
+        if constexpr (fitsInline<T>()) {
+            new (buf_) T(std::forward<Args>(args)...);
+        } else {
+            *reinterpret_cast<T**>(buf_) = new T(std::forward<Args>(args)...);
+        }
+        destroy_ = &destroyValue<T>;
+    }
+
+    template <typename T>
+    T take() {
+        T v(std::move(*valuePtr<T>()));
+        clearValue();
+        return v;
+    }
+
+    bool failed() const { return error_ != nullptr; }
+
+    std::exception_ptr takeError() {
+        std::exception_ptr e;
+        std::swap(e, error_);
+        return e;
+    }
+
+    void fail(std::exception_ptr e) {
+        clearValue();
+        error_ = std::move(e);
+    }
+
+    // The current link has its value (or error): hand it to the next step,
+    // or to whoever waits in get().
+    void complete() {
+        Cont c;
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            if (!popCont(c)) {
+                ready_ = true;
+                if (waiters_) cv_.notify_all();
+                return;
+            }
+        }
+        dispatch(c);
+    }
+
+    // Adds the step that consumes the tail link. Runs it right away if that
+    // link is already done. Inline steps run on whichever thread completes
+    // the link (joins use them: they only record the value); the rest are
+    // submitted to the pool.
+    void attach(Task fn, bool runInline) {
+        Cont c{std::move(fn), runInline};
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            if (!ready_) {
+                pushCont(std::move(c));
+                return;
+            }
+            ready_ = false;   // the step takes the value
+        }
+        dispatch(c);
+    }
+
+    bool ready() {
+        std::lock_guard<std::mutex> lk(m_);
+        return ready_;
+    }
+
+    // Runs other pool jobs while the chain is still going, then blocks only
+    // if the remaining step is running elsewhere.
+    void wait() {
+        if (pool_) {
+            while (!ready()) {
+                if (!pool_->try_run_one()) break;
+            }
+        }
+        std::unique_lock<std::mutex> lk(m_);
+        ++waiters_;
+        cv_.wait(lk, [&] { return ready_; });
+        --waiters_;
+    }
+
+private:
+    ChainState() = default;
+
+    struct Cont {
+        Task fn;
+        bool runInline = false;
+    };
+
+    // A chain built ahead of its values queues one step per link; the first
+    // is kept inline since that is all most chains ever have.
+    void pushCont(Cont&& c) {
+        if (!hasNext_) {
+            next_ = std::move(c);
+            hasNext_ = true;
+        } else {
+            more_.push(std::move(c));
+        }
+    }
+
+    bool popCont(Cont& out) {
+        if (!hasNext_) return false;
+        out = std::move(next_);
+        if (more_.empty()) {
+            hasNext_ = false;
+        } else {
+            next_ = std::move(more_.front());
+            more_.pop();
+        }
+        return true;
+    }
+
+    void dispatch(Cont& c) {
+        if (c.runInline || !pool_) {
+            c.fn();
+        } else {
+            pool_->submit(std::move(c.fn), prio_);
+        }
+    }
+
+    static constexpr size_t kInline = 64;
+
+    template <typename T>
+    static constexpr bool fitsInline() {
+        return sizeof(T) <= kInline && alignof(T) <= alignof(std::max_align_t);
+    }
+
+    template <typename T>
+    T* valuePtr() {
+        if constexpr (fitsInline<T>()) {
+            return std::launder(reinterpret_cast<T*>(buf_));
+        } else {
+            return *reinterpret_cast<T**>(buf_);
+        }
+    }
+
+    template <typename T>
+    static void destroyValue(void* p) noexcept {
+        if constexpr (fitsInline<T>()) {
+            static_cast<T*>(p)->~T();
+        } else {
+            delete *static_cast<T**>(p);
+        }
+    }
+
+    void clearValue() {
+        if (destroy_) {
+            destroy_(buf_);
+            destroy_ = nullptr;
+        }
+    }
+
+    struct FreeList {
+        ChainState* head = nullptr;
+        size_t count = 0;
+        ~FreeList() {
+            while (head) {
+                ChainState* n = head->nextFree_;
+                delete head;
+                head = n;
+            }
+        }
+    };
+
+    static FreeList& freeList() {
+        static thread_local FreeList fl;
+        return fl;
+    }
+
+    void recycle() {
+        clearValue();
+        error_ = nullptr;
+        ready_ = false;
+        FreeList& fl = freeList();
+        if (fl.count >= kMaxCached) {
+            delete this;
+            return;
+        }
+        nextFree_ = fl.head;
+        fl.head = this;
+        ++fl.count;
+    }
+
+    static constexpr size_t kMaxCached = 1024;
+
+    SimpleThreadPool* pool_ = nullptr;   // null only for an empty when_all: steps run inline
+    Priority prio_ = Priority::Normal;
+    std::atomic<int> refs_{0};
+    alignas(std::max_align_t) unsigned char buf_[kInline];
+    void (*destroy_)(void*) noexcept = nullptr;
+    std::exception_ptr error_;
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool ready_ = false;    // tail link done and not claimed by a step; under m_
+    int waiters_ = 0;       // under m_
+    bool hasNext_ = false;  // under m_
+    Cont next_;
+    RingQueue<Cont> more_;
+    ChainState* nextFree_ = nullptr;
+};
+
+// One step of a chain: runs fn on the previous link's value (nothing for
+// spawn() or a void link) and stores the result as the next one. Holds a
+// producer reference to the state. Like FutureJob, if the pool destroys it
+// unrun the chain fails with broken_promise instead of hanging.
+template <typename In, typename Out, typename F>
+struct LinkJob {
+    ChainState* st;
+    F fn;
+
+    LinkJob(ChainState* s, F&& f) : st(s), fn(std::move(f)) {}
+    LinkJob(LinkJob&& o) noexcept(std::is_nothrow_move_constructible_v<F>)
+        : st(o.st), fn(std::move(o.fn)) { o.st = nullptr; }
+    LinkJob& operator=(LinkJob&&) = delete;
+
+    void operator()() {
+        ChainState* s = st;
+        st = nullptr;
+        if (!s->failed()) {
+            try {
+                if constexpr (std::is_void_v<In>) {
+                    store(s);
+                } else {
+                    store(s, s->take<In>());
+                }
+            } catch (...) {
+                s->fail(std::current_exception());
+            }
+        }
+        s->complete();
+        s->release();
+    }
+
+    ~LinkJob() {
+        if (!st) return;
+        st->fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        st->complete();
+        st->release();
+    }
+
+private:
+    template <typename... Args>
+    void store(ChainState* s, Args&&... in) {
+        if constexpr (std::is_void_v<Out>) {
+            fn(std::forward<Args>(in)...);
+        } else {
+            s->emplace<Out>(fn(std::forward<Args>(in)...));
+        }
+    }
+};
+
+template <typename T, typename F>
+struct ThenResult {
+    using type = std::invoke_result_t<F&, T&&>;
+};
+
+template <typename F>
+struct ThenResult<void, F> {
+    using type = std::invoke_result_t<F&>;
+};
+
+struct FutureAccess;
+
+} // namespace detail
+
+template <typename T>
+class PoolFuture {
+public:
+    PoolFuture() = default;
+    PoolFuture(PoolFuture&& o) noexcept : st_(o.st_) { o.st_ = nullptr; }
+    PoolFuture& operator=(PoolFuture&& o) noexcept {
+        if (this != &o) {
+            if (st_) st_->release();
+            st_ = o.st_;
+            o.st_ = nullptr;
+        }
+        return *this;
+    }
+    ~PoolFuture() {
+        if (st_) st_->release();
+    }
+
+    bool valid() const { return st_ != nullptr; }
+    bool ready() const { return st_->ready(); }
+
+    // Waits for the chain, helping run pool jobs meanwhile, and rethrows its
+    // exception. Single use. Meant for the end of a chain; inside a job,
+    // return a then() instead of blocking.
+    T get() {
+        detail::ChainState* st = st_;
+        st_ = nullptr;
+        struct Drop {
+            detail::ChainState* s;
+            ~Drop() { s->release(); }
+        } drop{st};
+        st->wait();
+        if (st->failed()) std::rethrow_exception(st->takeError());
+        if constexpr (!std::is_void_v<T>) return st->take<T>();
+    }
+
+    // Runs fn(value) on the pool once this future's value exists (fn() for a
+    // void future) and returns the future of its result. Invalidates *this.
+    // Continuations up to SIMPLE_THREADPOOL_TASK_INLINE bytes (plus one
+    // pointer) do not allocate.
+    template <typename F, typename U = typename detail::ThenResult<T, std::decay_t<F>>::type>
+    PoolFuture<U> then(F&& fn) {
+        detail::ChainState* st = st_;
+        st_ = nullptr;
+        st->retain();   // for the step; our reference moves to the returned future
+        st->attach(detail::LinkJob<T, U, std::decay_t<F>>(st, std::decay_t<F>(std::forward<F>(fn))), false);
+        return PoolFuture<U>(st);
+    }
+
+private:
+    template <typename>
+    friend class PoolFuture;
+    friend struct detail::FutureAccess;
+
+    explicit PoolFuture(detail::ChainState* st) : st_(st) {}
+
+    detail::ChainState* st_ = nullptr;
+};
+
+namespace detail {
+
+struct FutureAccess {
+    template <typename T>
+    static PoolFuture<T> make(ChainState* st) { return PoolFuture<T>(st); }
+
+    template <typename T>
+    static ChainState* detach(PoolFuture<T>& f) {
+        ChainState* s = f.st_;
+        f.st_ = nullptr;
+        return s;
+    }
+};
+
+// Collects every input of a when_all; the last to arrive completes `out`.
+template <typename T>
+struct AllJoin {
+    using Slot = std::conditional_t<std::is_void_v<T>, char, std::optional<T>>;
+
+    AllJoin(size_t n, ChainState* o) : remaining(n), values(std::is_void_v<T> ? 0 : n), out(o) {}
+
+    void arrive(size_t i, ChainState* in) {
+        if (in->failed()) {
+            if (!failed.exchange(true, std::memory_order_relaxed)) error = in->takeError();
+        } else if constexpr (!std::is_void_v<T>) {
+            values[i].emplace(in->take<T>());
+        }
+        in->release();   // the input future's reference
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) finish();
+    }
+
+    void finish() {
+        if (error) {
+            out->fail(error);
+        } else if constexpr (!std::is_void_v<T>) {
+            std::vector<T> result;
+            result.reserve(values.size());
+            for (auto& v : values) result.push_back(std::move(*v));
+            out->emplace<std::vector<T>>(std::move(result));
+        }
+        out->complete();
+        out->release();
+        delete this;
+    }
+
+    std::atomic<size_t> remaining;
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;   // the first failure, written by whoever set `failed`
+    std::vector<Slot> values;
+    ChainState* out;
+};
+
+template <typename... Ts>
+struct TupleJoin {
+    explicit TupleJoin(ChainState* o) : out(o) {}
+
+    template <size_t I>
+    void arrive(ChainState* in) {
+        using T = std::tuple_element_t<I, std::tuple<Ts...>>;
+        if (in->failed()) {
+            if (!failed.exchange(true, std::memory_order_relaxed)) error = in->takeError();
+        } else {
+            std::get<I>(values).emplace(in->take<T>());
+        }
+        in->release();
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) finish();
+    }
+
+    void finish() {
+        if (error) {
+            out->fail(error);
+        } else {
+            out->emplace<std::tuple<Ts...>>(
+                std::apply([](auto&... v) { return std::tuple<Ts...>(std::move(*v)...); }, values));
+        }
+        out->complete();
+        out->release();
+        delete this;
+    }
+
+    std::atomic<size_t> remaining{sizeof...(Ts)};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::tuple<std::optional<Ts>...> values;
+    ChainState* out;
+};
+
+template <typename Join, size_t... I>
+void attachAll(Join* join, ChainState* const* ins, std::index_sequence<I...>) {
+    (ins[I]->attach([join, in = ins[I]] { join->template arrive<I>(in); }, true), ...);
+}
+
+} // namespace detail
+
+// What when_any yields: which input finished first, and its value.
+template <typename T>
+struct WhenAnyResult {
+    size_t index;
+    T value;
+};
+
+template <>
+struct WhenAnyResult<void> {
+    size_t index;
+};
+
+namespace detail {
+
+// The first input to arrive completes `out`; the record lives until the
+// last one has checked in.
+template <typename T>
+struct AnyJoin {
+    AnyJoin(size_t n, ChainState* o) : remaining(n), out(o) {}
+
+    void arrive(size_t i, ChainState* in) {
+        if (!decided.exchange(true, std::memory_order_acq_rel)) {
+            if (in->failed()) {
+                out->fail(in->takeError());
+            } else if constexpr (std::is_void_v<T>) {
+                out->emplace<WhenAnyResult<void>>(WhenAnyResult<void>{i});
+            } else {
+                out->emplace<WhenAnyResult<T>>(WhenAnyResult<T>{i, in->take<T>()});
+            }
+            out->complete();
+            out->release();
+        }
+        in->release();
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+    std::atomic<size_t> remaining;
+    std::atomic<bool> decided{false};
+    ChainState* out;
+};
+
+} // namespace detail
+
+// Starts a chain: fn() runs as a pool job and its result feeds the first then().
+template <typename F, typename R = std::invoke_result_t<std::decay_t<F>&>>
+PoolFuture<R> spawn(SimpleThreadPool& pool, F&& fn,
+                    SimpleThreadPool::Priority prio = SimpleThreadPool::Priority::Normal) {
+    auto* st = detail::ChainState::acquire(&pool, prio);
+    pool.submit(detail::LinkJob<void, R, std::decay_t<F>>(st, std::decay_t<F>(std::forward<F>(fn))), prio);
+    return detail::FutureAccess::make<R>(st);
+}
+
+// Ready once every input is: a vector of their values in input order
+// (nothing for void inputs), or the first exception once all have finished.
+// Steps after it run on the first input's pool; for no inputs it is ready at
+// once and a then() on it runs on the calling thread.
+template <typename T, typename R = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>>
+PoolFuture<R> when_all(std::vector<PoolFuture<T>> futures) {
+    SimpleThreadPool* pool = nullptr;
+    auto prio = SimpleThreadPool::Priority::Normal;
+    if (!futures.empty()) {
+        auto* first = detail::FutureAccess::detach(futures[0]);
+        pool = first->pool();
+        prio = first->priority();
+        futures[0] = detail::FutureAccess::make<T>(first);
+    }
+    auto* out = detail::ChainState::acquire(pool, prio);
+    auto result = detail::FutureAccess::make<R>(out);
+    if (futures.empty()) {
+        if constexpr (!std::is_void_v<T>) out->emplace<std::vector<T>>();
+        out->complete();
+        out->release();
+        return result;
+    }
+    auto* join = new detail::AllJoin<T>(futures.size(), out);
+    for (size_t i = 0; i < futures.size(); ++i) {
+        auto* in = detail::FutureAccess::detach(futures[i]);
+        in->attach([join, i, in] { join->arrive(i, in); }, true);
+    }
+    return result;
+}
+
+// Heterogeneous form: a tuple of the values.
+template <typename T0, typename... Ts>
+PoolFuture<std::tuple<T0, Ts...>> when_all(PoolFuture<T0> first, PoolFuture<Ts>... rest) {
+    static_assert(!std::is_void_v<T0> && (!std::is_void_v<Ts> && ...),
+                  "use the vector form of when_all for void futures");
+    auto* head = detail::FutureAccess::detach(first);
+    auto* out = detail::ChainState::acquire(head->pool(), head->priority());
+    auto result = detail::FutureAccess::make<std::tuple<T0, Ts...>>(out);
+    auto* join = new detail::TupleJoin<T0, Ts...>(out);
+    detail::ChainState* ins[] = {head, detail::FutureAccess::detach(rest)...};
+    detail::attachAll(join, ins, std::index_sequence_for<T0, Ts...>{});
+    return result;
+}
+
+// Ready as soon as any input is, with that input's index and value (or its
+// exception). The other values are dropped when they arrive.
+template <typename T>
+PoolFuture<WhenAnyResult<T>> when_any(std::vector<PoolFuture<T>> futures) {
+    if (futures.empty()) throw std::invalid_argument("when_any of no futures");
+    auto* first = detail::FutureAccess::detach(futures[0]);
+    auto* out = detail::ChainState::acquire(first->pool(), first->priority());
+    futures[0] = detail::FutureAccess::make<T>(first);
+    auto result = detail::FutureAccess::make<WhenAnyResult<T>>(out);
+    auto* join = new detail::AnyJoin<T>(futures.size(), out);
+    for (size_t i = 0; i < futures.size(); ++i) {
+        auto* in = detail::FutureAccess::detach(futures[i]);
+        in->attach([join, i, in] { join->arrive(i, in); }, true);
+    }
+    return result;
+}
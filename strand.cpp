@@ -0,0 +1,71 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "strand.h"
+
+// ---------------- Demo ----------------
+// Per-session message handling: each session's messages must be applied in
+// order and never concurrently, while different sessions proceed in parallel.
+// The old way holds a mutex per session inside every job; a strand per session
+// orders the jobs instead, so no worker sits blocked on another's session.
+struct Session {
+    long lastSeq = -1;
+    long outOfOrder = 0;
+    std::mutex m;   // only the mutex version uses this
+};
+
+static void handle(Session& s, long seq) {
+    if (seq != s.lastSeq + 1) ++s.outOfOrder;
+    s.lastSeq = seq;
+    std::this_thread::sleep_for(std::chrono::microseconds(20));   // a little I/O
+}
+
+int main() {
+    const int sessions = 8, messages = 500;
+    SimpleThreadPool pool(4);
+
+    {
+        std::vector<Session> state(sessions);
+        std::vector<std::atomic<long>> nextSeq(sessions);
+        auto t0 = std::chrono::steady_clock::now();
+        for (int k = 0; k < sessions; ++k) {       // each session's messages arrive in a burst
+            for (long i = 0; i < messages; ++i) {
+                pool.submit([&state, &nextSeq, k] {
+                    // Take a ticket and the lock in one go, like a per-session queue would.
+                    std::lock_guard<std::mutex> lk(state[k].m);
+                    handle(state[k], nextSeq[k]++);
+                });
+            }
+        }
+        pool.wait_idle();
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "mutex per session: " << ms << " ms\n";
+    }
+
+    {
+        std::vector<Session> state(sessions);
+        KeyedStrand<int> strands(pool, 64);
+        auto t0 = std::chrono::steady_clock::now();
+        for (int k = 0; k < sessions; ++k) {
+            for (long i = 0; i < messages; ++i) {
+                strands.post(k, [&state, k, i] { handle(state[k], i); });
+            }
+        }
+        pool.wait_idle();
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        long bad = 0;
+        for (auto& s : state) bad += s.outOfOrder + (s.lastSeq != messages - 1);
+        std::cout << "keyed strands:     " << ms << " ms, " << bad << " out of order\n";
+    }
+
+    // A strand job can tell it is on its strand and call straight through.
+    Strand log(pool);
+    log.post([&log] { std::cout << "on strand: " << log.running_in_this_thread() << "\n"; });
+    pool.wait_idle();
+    std::cout << "outside strand: " << log.running_in_this_thread() << "\n";
+    return 0;
+}
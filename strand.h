@@ -0,0 +1,287 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include "threadpool.h"
+
+namespace detail {
+
+// Shared by a Strand's handles and its drain job. Posted jobs go onto an
+// intrusive Vyukov MPSC list (one exchange per post, no lock), and `queued_`
+// counts them: the post that takes it from 0 to 1 schedules a drain job on the
+// pool, so at most one worker runs the strand at a time and an idle strand
+// costs nothing. The drain runs jobs in post order and never waits: if it hits
+// a post that is half-linked, or has run `maxRun` jobs, it re-queues itself
+// behind the rest of the pool's work and returns.
+class StrandState {
+public:
+    using Priority = SimpleThreadPool::Priority;
+
+    StrandState(SimpleThreadPool& pool, Priority prio, size_t maxRun)
+        : pool_(pool), prio_(prio), maxRun_(maxRun ? maxRun : 1), head_(&stub_), tail_(&stub_) {}
+
+    ~StrandState() {
+        // Only jobs the pool refused to schedule (it shut down) are left here.
+        while (Node* n = pop()) recycle(n);
+        Node* n = free_.load(std::memory_order_acquire);
+        while (n) {
+            Node* next = n->nextFree;
+            delete n;
+            n = next;
+        }
+    }
+
+    void retain() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+    void post(Task fn) {
+        Node* n = allocNode();
+        n->fn = std::move(fn);
+        push(n);
+        if (queued_.fetch_add(1, std::memory_order_acq_rel) == 0) schedule(false);
+    }
+
+    bool runningHere() const { return current() == this; }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        Task fn;
+        Node* nextFree = nullptr;
+    };
+
+    // Holds a reference for as long as it is queued. If the pool destroys it
+    // unrun (refused or dropped by a bounded queue) it queues a fresh one over
+    // capacity instead, since the strand has no other way to restart; only a
+    // shut-down pool really drops it.
+    struct DrainJob {
+        StrandState* st;
+
+        explicit DrainJob(StrandState* s) : st(s) {}
+        DrainJob(DrainJob&& o) noexcept : st(o.st) { o.st = nullptr; }
+        DrainJob& operator=(DrainJob&&) = delete;
+
+        void operator()() {
+            StrandState* s = st;
+            st = nullptr;
+            s->drain();
+            s->release();
+        }
+
+        ~DrainJob() {
+            if (!st) return;
+            StrandState* s = st;
+            st = nullptr;
+            if (s->pool_.stopping_.load()) {
+                s->release();
+                return;
+            }
+            s->pool_.submitUnbounded(DrainJob(s), s->prio_);
+        }
+    };
+
+    // The first drain goes through submit(), so from a worker it stays local
+    // (in the LIFO slot with Options::lifoSlot, running next while the posting
+    // job's data is still in cache).
+    // Re-queues go to the back of the shared lane so other strands get a turn.
+    void schedule(bool yield) {
+        retain();
+        if (yield) {
+            pool_.submitUnbounded(DrainJob(this), prio_);
+        } else {
+            pool_.submit(DrainJob(this), prio_);
+        }
+    }
+
+    void drain() {
+        const StrandState* outer = current();
+        current() = this;
+        for (size_t ran = 0;;) {
+            Node* n = pop();
+            if (!n) {
+                // A producer has swapped head_ but not linked its node yet.
+                schedule(true);
+                break;
+            }
+            n->fn();
+            recycle(n);
+            if (queued_.fetch_sub(1, std::memory_order_acq_rel) == 1) break;
+            // A stopping pool refuses re-queues, so finish the backlog now.
+            if (++ran == maxRun_ && !pool_.stopping_.load()) {
+                schedule(true);
+                break;
+            }
+        }
+        current() = outer;
+    }
+
+    void push(Node* n) {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // Single consumer (whoever holds the drain). Null when empty or when the
+    // newest node is still being linked.
+    Node* pop() {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) return nullptr;
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != head_.load(std::memory_order_acquire)) return nullptr;
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    // Nodes are cached per thread like FutureState, but the drain hands a
+    // finished node back to its strand (`free_`), not to the worker that ran
+    // it; a post that finds its thread's cache empty takes the strand's whole
+    // list in one exchange. So a thread outside the pool gets back the nodes
+    // it posted, and a cache never holds more than a strand's peak backlog.
+    // The list is only ever emptied whole, so pushing onto it has no ABA.
+    struct FreeList {
+        Node* head = nullptr;
+        ~FreeList() {
+            while (head) {
+                Node* n = head->nextFree;
+                delete head;
+                head = n;
+            }
+        }
+    };
+
+    static FreeList& freeList() {
+        static thread_local FreeList fl;
+        return fl;
+    }
+
+    Node* allocNode() {
+        FreeList& fl = freeList();
+        Node* n = fl.head;
+        if (!n) n = free_.exchange(nullptr, std::memory_order_acquire);
+        if (!n) return new Node;
+        fl.head = n->nextFree;
+        return n;
+    }
+
+    void recycle(Node* n) {
+        n->fn.reset();
+        Node* head = free_.load(std::memory_order_relaxed);
+        do {
+            n->nextFree = head;
+        } while (!free_.compare_exchange_weak(head, n, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    static const StrandState*& current() {
+        static thread_local const StrandState* s = nullptr;
+        return s;
+    }
+
+    SimpleThreadPool& pool_;
+    Priority prio_;
+    size_t maxRun_;
+    std::atomic<uint32_t> refs_{1};
+    alignas(64) std::atomic<Node*> head_;   // producers
+    alignas(64) Node* tail_;                // the drain
+    std::atomic<size_t> queued_{0};
+    std::atomic<Node*> free_{nullptr};      // drained nodes, taken whole by posts
+    Node stub_;
+};
+
+} // namespace detail
+
+// Serial executor on a SimpleThreadPool: jobs posted to one strand run one at
+// a time, in post order, on whichever worker picks the strand up; different
+// strands run in parallel. Replaces a mutex held inside each job, so no worker
+// ever blocks waiting for another one's session. Posting is lock-free and,
+// once the node cache is warm, allocation-free for jobs that fit a Task inline.
+//
+// Copies are handles to the same strand. A strand keeps the pool busy for at
+// most `maxRun` jobs per turn before going back in the queue. Like submit(),
+// jobs must not throw. Jobs posted after the pool shut down never run.
+class Strand {
+public:
+    explicit Strand(SimpleThreadPool& pool,
+                    SimpleThreadPool::Priority prio = SimpleThreadPool::Priority::Normal,
+                    size_t maxRun = 64)
+        : st_(new detail::StrandState(pool, prio, maxRun)) {}
+
+    Strand(const Strand& o) noexcept : st_(o.st_) { st_->retain(); }
+    Strand& operator=(Strand o) noexcept {
+        std::swap(st_, o.st_);
+        return *this;
+    }
+    ~Strand() { st_->release(); }
+
+    template <typename F>
+    void post(F&& fn) {
+        st_->post(Task(std::forward<F>(fn)));
+    }
+
+    // True inside a job of this strand, e.g. to skip a post and just call.
+    bool running_in_this_thread() const { return st_->runningHere(); }
+
+private:
+    detail::StrandState* st_;
+};
+
+// A fixed set of strands with keys hashed onto them: every job for one key
+// runs in order, distinct keys mostly run in parallel. Keys that share a strand
+// are serialized with each other too, so size `strands` well above the worker
+// count (rounded up to a power of two).
+template <typename Key, typename Hash = std::hash<Key>>
+class KeyedStrand {
+public:
+    explicit KeyedStrand(SimpleThreadPool& pool, size_t strands = 256,
+                         SimpleThreadPool::Priority prio = SimpleThreadPool::Priority::Normal,
+                         size_t maxRun = 64, Hash hash = Hash())
+        : hash_(std::move(hash)) {
+        size_t n = 1;
+        while (n < strands) n <<= 1;
+        shift_ = 64;
+        for (size_t m = n; m > 1; m >>= 1) --shift_;
+        strands_.reserve(n);
+        for (size_t i = 0; i < n; ++i) strands_.emplace_back(pool, prio, maxRun);
+    }
+
+    template <typename F>
+    void post(const Key& key, F&& fn) {
+        strand(key).post(std::forward<F>(fn));
+    }
+
+    // Fibonacci hashing on top of Hash: std::hash is the identity for
+    // integers, so ids sharing a stride would pile onto a few strands under a
+    // plain mask.
+    Strand& strand(const Key& key) {
+        if (strands_.size() == 1) return strands_[0];
+        uint64_t h = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+        return strands_[static_cast<size_t>(h >> shift_)];
+    }
+
+    size_t size() const { return strands_.size(); }
+
+private:
+    Hash hash_;
+    unsigned shift_ = 64;
+    std::vector<Strand> strands_;
+};
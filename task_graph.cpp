@@ -0,0 +1,48 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "task_graph.h"
+
+// ---------------- Demo ----------------
+// A per-frame pipeline declared once and replayed:
+//
+//            +-> physics -+
+//   input ---+            +--> render --> present
+//            +-> audio ---+
+//
+int main() {
+    SimpleThreadPool::Options opts;
+    opts.threads = 4;
+    opts.workStealing = true;
+    SimpleThreadPool pool(opts);
+
+    std::atomic<int> step{0};
+    auto stage = [&step](const char* name, int ms) {
+        return [&step, name, ms] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+            std::cout << "  " << step++ << ": " << name << "\n";
+        };
+    };
+
+    TaskGraph frame;
+    auto input = frame.add(stage("input", 5));
+    auto physics = frame.add(stage("physics", 20));
+    auto audio = frame.add(stage("audio", 10));
+    auto render = frame.add(stage("render", 15));
+    auto present = frame.add(stage("present", 1));
+
+    frame.precede(input, physics);
+    frame.precede(input, audio);
+    frame.precede(physics, render);
+    frame.precede(audio, render);
+    frame.precede(render, present);
+
+    for (int f = 0; f < 3; ++f) {
+        step = 0;
+        std::cout << "frame " << f << "\n";
+        frame.run(pool);  // no setup cost per frame
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+#include <cstddef>
+
+#include "threadpool.h"
+
+// A DAG of jobs built once and run many times on a SimpleThreadPool.
+// Each node keeps its static predecessor count and a live countdown; when a
+// node finishes it decrements its successors' countdowns and every successor
+// that reaches zero is released immediately, so there is no barrier between
+// "stages". A run allocates nothing: the countdowns are reset in place and the
+// per-run bookkeeping is a TaskGroup on the caller's stack.
+class TaskGraph {
+public:
+    using NodeId = size_t;
+
+    TaskGraph() = default;
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    // The node's job is invoked once per run(), so it must be re-runnable.
+    NodeId add(Task work) {
+        nodes_.emplace_back(std::move(work));
+        checked_ = false;
+        return nodes_.size() - 1;
+    }
+
+    // `before` must finish before `after` starts.
+    void precede(NodeId before, NodeId after) {
+        if (before >= nodes_.size() || after >= nodes_.size()) throw std::out_of_range("TaskGraph node");
+        nodes_[before].successors.push_back(after);
+        ++nodes_[after].predecessors;
+        checked_ = false;
+    }
+
+    size_t size() const { return nodes_.size(); }
+
+    // Runs every node once, respecting the edges, and returns when all are done.
+    // The calling thread helps run jobs while it waits. If a node throws, its
+    // successors are skipped and the first exception is rethrown here.
+    void run(SimpleThreadPool& pool) {
+        if (!checked_) checkAcyclic();
+
+        for (Node& n : nodes_) n.remaining.store(n.predecessors, std::memory_order_relaxed);
+
+        TaskGroup group(pool);
+        for (NodeId id = 0; id < nodes_.size(); ++id) {
+            if (nodes_[id].predecessors == 0) group.run([this, &group, id] { runFrom(group, id); });
+        }
+        group.wait();
+    }
+
+private:
+    struct Node {
+        explicit Node(Task w) : work(std::move(w)) {}
+
+        Task work;
+        std::vector<NodeId> successors;
+        int predecessors = 0;
+        std::atomic<int> remaining{0};
+    };
+
+    // Runs `id`, then keeps going on this thread with one of the successors it
+    // released (its inputs are hot in cache) and hands the others to the pool.
+    void runFrom(TaskGroup& group, NodeId id) {
+        for (;;) {
+            Node& node = nodes_[id];
+            node.work();
+
+            NodeId next = kNone;
+            for (NodeId s : node.successors) {
+                if (nodes_[s].remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+                if (next != kNone) group.run([this, &group, next] { runFrom(group, next); });
+                next = s;
+            }
+            if (next == kNone) return;
+            id = next;
+        }
+    }
+
+    // Kahn's algorithm; only re-run after the graph changed.
+    void checkAcyclic() {
+        std::vector<int> indegree(nodes_.size());
+        std::vector<NodeId> ready;
+        for (NodeId id = 0; id < nodes_.size(); ++id) {
+            indegree[id] = nodes_[id].predecessors;
+            if (indegree[id] == 0) ready.push_back(id);
+        }
+        size_t seen = 0;
+        while (!ready.empty()) {
+            NodeId id = ready.back();
+            ready.pop_back();
+            ++seen;
+            for (NodeId s : nodes_[id].successors) {
+                if (--indegree[s] == 0) ready.push_back(s);
+            }
+        }
+        if (seen != nodes_.size()) throw std::logic_error("TaskGraph has a cycle");
+        checked_ = true;
+    }
+
+    static constexpr NodeId kNone = static_cast<NodeId>(-1);
+
+    std::deque<Node> nodes_;   // deque: Node holds an atomic, so it must not move
+    bool checked_ = false;
+};
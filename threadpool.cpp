@@ -1,92 +1,144 @@
 #include <iostream>
-#include <vector>
 #include <thread>
-#include <queue>
-#include <mutex>
-#include <condition_variable>
-#include <functional>
 #include <chrono>
+#include <vector>
+#include <atomic>
+#include <fstream>
 
-class SimpleThreadPool {
-public:
-    explicit SimpleThreadPool(size_t n) {
-        if (n == 0) n = 1;
-        for (size_t i = 0; i < n; ++i) {
-            workers_.emplace_back([this, i] { workerLoop(i); });
-        }
-    }
+#include "threadpool.h"
 
-    SimpleThreadPool(const SimpleThreadPool&) = delete;
-    SimpleThreadPool& operator=(const SimpleThreadPool&) = delete;
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-    // Fire-and-forget submit
-    void submit(std::function<void()> job) {
-        {
-            std::lock_guard<std::mutex> lk(m_);
-            if (stopping_) return;            // or throw; your choice
-            q_.push(std::move(job));
-        }
-        cv_.notify_one();
-    }
+// ---------------- Demo ----------------
+int main() {
+    SimpleThreadPool pool(3);
 
-    void shutdown() {
-        {
-            std::lock_guard<std::mutex> lk(m_);
-            stopping_ = true;
-        }
-        cv_.notify_all();
-        for (auto& t : workers_) {
-            if (t.joinable()) t.join();
-        }
-        workers_.clear();
+    for (int i = 1; i <= 8; ++i) {
+        pool.submit([i] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(150));
+            std::cout << "Task " << i << " done on thread " 
+                      << std::this_thread::get_id() << "\n";
+        });
     }
 
-    ~SimpleThreadPool() {
-        shutdown();
+    // Jobs can hand a result back through a pooled future
+    auto answer = pool.submit_future([] { return 6 * 7; });
+    std::cout << "Answer: " << answer.get() << "\n";
+
+    // Split a loop across the pool; returns once every chunk is done
+    std::vector<long> squares(1000);
+    pool.parallel_for(size_t(0), squares.size(), size_t(100), [&](size_t i) { squares[i] = long(i * i); });
+    std::cout << "Last square: " << squares.back() << "\n";
+
+    // Wait for a batch of our own, helping out while we wait
+    std::atomic<int> groupSum{0};
+    TaskGroup group(pool);
+    for (int i = 1; i <= 10; ++i) {
+        group.run([i, &groupSum] { groupSum += i; });
     }
+    group.wait();
+    std::cout << "Group sum: " << groupSum << "\n";
 
-private:
-    void workerLoop(size_t workerId) {
-        while (true) {
-            std::function<void()> job;
+    // A busy outside producer can batch its submits: one lock per 64 jobs,
+    // and nothing waits in the buffer longer than 100us
+    {
+        SubmitBatcher batcher(pool);
+        std::atomic<int> events{0};
+        for (int i = 0; i < 1000; ++i) batcher.submit([&events] { ++events; });
+        batcher.flush();
+        pool.wait_idle();
+        std::cout << "Batched events: " << events << "\n";
+    }
 
-            {
-                std::unique_lock<std::mutex> lk(m_);
-                cv_.wait(lk, [&] { return stopping_ || !q_.empty(); });
+    // Abandon a request: one cancel() covers all its jobs; queued ones are
+    // skipped, running ones notice on their next poll
+    {
+        CancellationSource request;
+        std::atomic<int> ran{0};
+        for (int i = 0; i < 10000; ++i) {
+            pool.submit([&ran, token = request.token()] {
+                for (int step = 0; step < 100 && !token.cancelled(); ++step) {
+                }
+                ++ran;
+            }, request.token());
+        }
+        request.cancel();
+        pool.wait_idle();
+        std::cout << "Jobs run after cancel: " << ran << " of 10000\n";
+    }
 
-                if (stopping_ && q_.empty()) return;
+    // Timers: a timeout that is cancelled before it fires, and a periodic job
+    {
+        std::atomic<int> heartbeats{0};
+        auto timeout = pool.submit_after(std::chrono::milliseconds(500), [] { std::cout << "Timed out!\n"; });
+        auto heartbeat = pool.submit_every(std::chrono::milliseconds(10), [&heartbeats] { ++heartbeats; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(55));
+        std::cout << "Timeout cancelled: " << timeout.cancel() << "\n";
+        heartbeat.cancel();
+        pool.wait_idle();
+        std::cout << "Heartbeats: " << heartbeats << "\n";
+    }
 
-                job = std::move(q_.front());
-                q_.pop();
+#ifdef __linux__
+    // fd readiness without an event-loop thread: an idle worker waits in
+    // epoll_wait and runs the callback itself when the pipe has data
+    {
+        SimpleThreadPool::Options opts;
+        opts.threads = 2;
+        opts.eventLoop = true;
+        SimpleThreadPool loop(opts);
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0) {
+            std::atomic<int> received{0};
+            auto watch = loop.watch(fds[0], EPOLLIN, [&received, fd = fds[0]](uint32_t) {
+                char buf[64];
+                ssize_t n;
+                while ((n = read(fd, buf, sizeof(buf))) > 0) received += int(n);
+            });
+            for (int i = 0; i < 5; ++i) {
+                if (write(fds[1], "ping", 4) != 4) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
             }
-
-            // Run outside lock
-            job();
+            while (received < 20) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            watch.cancel();
+            std::cout << "Bytes read from pipe: " << received << "\n";
+            close(fds[0]);
+            close(fds[1]);
         }
     }
+#endif
 
-private:
-    std::vector<std::thread> workers_;
-    std::queue<std::function<void()>> q_;
-    std::mutex m_;
-    std::condition_variable cv_;
-    bool stopping_ = false;
-};
+    // Wait until everything submitted above has run
+    pool.wait_idle();
 
-// ---------------- Demo ----------------
-int main() {
-    SimpleThreadPool pool(3);
-
-    for (int i = 1; i <= 8; ++i) {
-        pool.submit([i] {
-            std::this_thread::sleep_for(std::chrono::milliseconds(150));
-            std::cout << "Task " << i << " done on thread " 
-                      << std::this_thread::get_id() << "\n";
-        });
+#if SIMPLE_THREADPOOL_TRACE
+    // Built with -DSIMPLE_THREADPOOL_TRACE=1: labelled jobs, then a trace to
+    // open in https://ui.perfetto.dev or chrome://tracing
+    for (int i = 0; i < 6; ++i) {
+        pool.submit("thumbnail", [] { std::this_thread::sleep_for(std::chrono::milliseconds(2)); });
     }
+    pool.wait_idle();
+    std::ofstream trace("pool_trace.json");
+    pool.write_trace(trace);
+    std::cout << "Trace written to pool_trace.json\n";
+#endif
 
-    // Give tasks time to run (since we aren't waiting on futures)
-    std::this_thread::sleep_for(std::chrono::seconds(2));
+#if SIMPLE_THREADPOOL_METRICS
+    // Built with -DSIMPLE_THREADPOOL_METRICS=1: where the time went, queue
+    // wait vs run time, per-worker busy/idle
+    auto m = pool.metrics();
+    std::cout << "Queue wait p50/p99: " << m.queueWait.percentile(0.5) / 1000 << "/"
+              << m.queueWait.percentile(0.99) / 1000 << " us, run time p99: "
+              << m.runTime.percentile(0.99) / 1000 << " us over " << m.runTime.count() << " jobs\n";
+    for (size_t w = 0; w < m.workers.size(); ++w) {
+        std::cout << "Worker " << w << ": " << m.workers[w].jobs << " jobs, busy "
+                  << m.workers[w].busyNs / 1000000 << " ms, idle " << m.workers[w].idleNs / 1000000 << " ms\n";
+    }
+    std::cout << "Normal lane high water: " << m.lanes[1].highWater << "\n";
+#endif
 
     // pool.shutdown(); // optional (destructor does it)
     return 0;
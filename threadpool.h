@@ -0,0 +1,3538 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <exception>
+#include <future>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <array>
+#include <unordered_map>
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define SIMPLE_THREADPOOL_COROUTINES 1
+#endif
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// Chase-Lev work-stealing deque with a fixed power-of-two capacity.
+// The owning worker pushes/pops at the bottom (LIFO, cache-hot), thieves
+// take from the top (FIFO, oldest work first). T must be a pointer type;
+// an empty deque returns nullptr.
+template <typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 1024) {
+        size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        buf_.reset(new std::atomic<T>[cap]);
+        mask_ = static_cast<int64_t>(cap) - 1;
+    }
+
+    // Owner only. Returns false when full (caller falls back to the shared queue).
+    bool push(T item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        if (b - t > mask_) return false;
+        buf_[b & mask_].store(item, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_release);  // publishes the slot to thieves
+        return true;
+    }
+
+    // Owner only.
+    T pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        T item = nullptr;
+        if (t <= b) {
+            item = buf_[b & mask_].load(std::memory_order_relaxed);
+            if (t == b) {
+                // Last element: race against thieves for it.
+                if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread. Returns nullptr if empty or if it lost a race.
+    T steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+
+        T item = buf_[t & mask_].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    bool empty() const {
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+
+    // Approximate while thieves are active.
+    size_t size() const {
+        int64_t n = bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed);
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+
+private:
+    // Keep the thief-side and owner-side indices on separate cache lines.
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    alignas(64) std::unique_ptr<std::atomic<T>[]> buf_;
+    int64_t mask_ = 0;
+};
+
+#ifndef SIMPLE_THREADPOOL_TASK_INLINE
+#define SIMPLE_THREADPOOL_TASK_INLINE 64
+#endif
+
+// Queue-wait/run-time histograms and per-worker busy/idle accounting. Off by
+// default: it costs a few clock reads per job, which doubles the overhead of
+// a tiny one. Build with -DSIMPLE_THREADPOOL_METRICS=1; without it metrics()
+// fills in only the lanes' depth and enqueued counts.
+#ifndef SIMPLE_THREADPOOL_METRICS
+#define SIMPLE_THREADPOOL_METRICS 0
+#endif
+
+// Per-job trace events (submit, start, end, worker, label) kept in per-worker
+// rings and dumped with SimpleThreadPool::write_trace() for Perfetto or
+// chrome://tracing. Off by default; build with -DSIMPLE_THREADPOOL_TRACE=1.
+#ifndef SIMPLE_THREADPOOL_TRACE
+#define SIMPLE_THREADPOOL_TRACE 0
+#endif
+
+// Move-only type-erased `void()` callable. Callables up to InlineBytes (and
+// nothrow-movable) are stored in place, so submitting them never allocates.
+// Larger ones fall back to a single heap allocation.
+template <size_t InlineBytes>
+class BasicTask {
+public:
+    BasicTask() noexcept = default;
+
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, BasicTask>>>
+    BasicTask(F&& f) {
+        using Fn = std::decay_t<F>;
+        if constexpr (fitsInline<Fn>()) {
+            new (buf_) Fn(std::forward<F>(f));
+            ops_ = &inlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(buf_) = new Fn(std::forward<F>(f));
+            ops_ = &heapOps<Fn>;
+        }
+    }
+
+    BasicTask(BasicTask&& o) noexcept { moveFrom(o); }
+
+    BasicTask& operator=(BasicTask&& o) noexcept {
+        if (this != &o) {
+            reset();
+            moveFrom(o);
+        }
+        return *this;
+    }
+
+    BasicTask(const BasicTask&) = delete;
+    BasicTask& operator=(const BasicTask&) = delete;
+
+    ~BasicTask() { reset(); }
+
+    void operator()() { ops_->invoke(buf_); }
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+#if SIMPLE_THREADPOOL_METRICS || SIMPLE_THREADPOOL_TRACE
+    // steady_clock nanoseconds at which the pool queued this task; travels
+    // with the task so the wait can be measured wherever it ends up running.
+    int64_t enqueuedAt = 0;
+#endif
+#if SIMPLE_THREADPOOL_TRACE
+    const char* label = nullptr;   // trace event name; must outlive the pool's trace
+#endif
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(buf_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void*);
+        void (*move)(void* src, void* dst) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template <typename Fn>
+    static constexpr bool fitsInline() {
+        return sizeof(Fn) <= InlineBytes && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template <typename Fn>
+    static constexpr Ops inlineOps = {
+        [](void* p) { (*static_cast<Fn*>(p))(); },
+        [](void* src, void* dst) noexcept {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* p) noexcept { static_cast<Fn*>(p)->~Fn(); },
+    };
+
+    template <typename Fn>
+    static constexpr Ops heapOps = {
+        [](void* p) { (**static_cast<Fn**>(p))(); },
+        [](void* src, void* dst) noexcept { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); },
+        [](void* p) noexcept { delete *static_cast<Fn**>(p); },
+    };
+
+    void moveFrom(BasicTask& o) noexcept {
+#if SIMPLE_THREADPOOL_METRICS || SIMPLE_THREADPOOL_TRACE
+        enqueuedAt = o.enqueuedAt;
+#endif
+#if SIMPLE_THREADPOOL_TRACE
+        label = o.label;
+#endif
+        if (o.ops_) {
+            o.ops_->move(o.buf_, buf_);
+            ops_ = o.ops_;
+            o.ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char buf_[InlineBytes < sizeof(void*) ? sizeof(void*) : InlineBytes];
+    const Ops* ops_ = nullptr;
+};
+
+using Task = BasicTask<SIMPLE_THREADPOOL_TASK_INLINE>;
+
+// Growable circular FIFO. Unlike std::queue/std::deque it never frees its
+// storage, so a steady push/pop cycle does not touch the allocator.
+template <typename T>
+class RingQueue {
+public:
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+
+    void push(T&& v) {
+        if (count_ == buf_.size()) grow();
+        buf_[(head_ + count_) & (buf_.size() - 1)] = std::move(v);
+        ++count_;
+    }
+
+    T& front() { return buf_[head_]; }
+
+    void pop() {
+        buf_[head_] = T();
+        head_ = (head_ + 1) & (buf_.size() - 1);
+        --count_;
+    }
+
+private:
+    void grow() {
+        std::vector<T> next(buf_.empty() ? 64 : buf_.size() * 2);
+        for (size_t i = 0; i < count_; ++i) {
+            next[i] = std::move(buf_[(head_ + i) & (buf_.size() - 1)]);
+        }
+        buf_.swap(next);
+        head_ = 0;
+    }
+
+    std::vector<T> buf_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+};
+
+// Tell the core we are busy-waiting (frees pipeline resources for an SMT sibling).
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Bounded lock-free MPMC ring (Vyukov). Every slot carries a sequence number
+// that tells producers and consumers whether it is free for lap `pos`, so
+// neither side takes a lock; each operation is one CAS on its own index.
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity = 4096) {
+        size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        cells_.reset(new Cell[cap]);
+        mask_ = cap - 1;
+        for (size_t i = 0; i < cap; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // Moves from v only on success; returns false when full.
+    bool try_push(T&& v) {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& c = cells_[pos & mask_];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = std::move(v);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& out) {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& c = cells_[pos & mask_];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(c.value);
+                    c.value = T();
+                    c.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> enqueuePos_{0};
+    alignas(64) std::atomic<size_t> dequeuePos_{0};
+};
+
+// CPU layout as read from /sys/devices/system/cpu. Where sysfs is unavailable
+// every CPU is reported as its own core on node 0 with no shared caches.
+struct CpuTopology {
+    struct Cpu {
+        int id = 0;
+        int core = -1;      // unique per physical core; SMT siblings share it
+        int l2 = -1;        // lowest CPU id sharing this CPU's L2, -1 if unknown
+        int l3 = -1;        // lowest CPU id sharing this CPU's L3, -1 if unknown
+        int node = 0;       // NUMA node
+    };
+
+    std::vector<Cpu> cpus;
+
+    static CpuTopology detect() {
+        CpuTopology topo;
+        std::vector<int> online = parseCpuList(readFile("/sys/devices/system/cpu/online"));
+        if (online.empty()) {
+            unsigned n = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned i = 0; i < n; ++i) online.push_back(static_cast<int>(i));
+        }
+        for (int id : online) {
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+            Cpu c;
+            c.id = id;
+            int package = readInt(base + "/topology/physical_package_id", 0);
+            int core = readInt(base + "/topology/core_id", id);
+            c.core = package * 65536 + core;
+            for (int idx = 0;; ++idx) {
+                std::string cache = base + "/cache/index" + std::to_string(idx);
+                int level = readInt(cache + "/level", -1);
+                if (level < 0) break;
+                std::vector<int> shared = parseCpuList(readFile(cache + "/shared_cpu_list"));
+                int first = shared.empty() ? id : *std::min_element(shared.begin(), shared.end());
+                if (level == 2) c.l2 = first;
+                if (level == 3) c.l3 = first;
+            }
+            c.node = nodeOf(base);
+            topo.cpus.push_back(c);
+        }
+        return topo;
+    }
+
+    // 0: same core or L2, 1: same L3, 2: same NUMA node, 3: remote node.
+    static int distance(const Cpu& a, const Cpu& b) {
+        if (a.core == b.core || (a.l2 >= 0 && a.l2 == b.l2)) return 0;
+        if (a.l3 >= 0 && a.l3 == b.l3) return 1;
+        if (a.node == b.node) return 2;
+        return 3;
+    }
+
+    // Order to hand CPUs to workers: one CPU per physical core first, keeping
+    // cores that share an L3/node together, then the SMT siblings.
+    std::vector<size_t> pinOrder() const {
+        std::vector<size_t> idx(cpus.size());
+        for (size_t i = 0; i < idx.size(); ++i) idx[i] = i;
+        std::stable_sort(idx.begin(), idx.end(), [&](size_t a, size_t b) {
+            const Cpu& x = cpus[a];
+            const Cpu& y = cpus[b];
+            if (x.node != y.node) return x.node < y.node;
+            if (x.l3 != y.l3) return x.l3 < y.l3;
+            if (x.core != y.core) return x.core < y.core;
+            return x.id < y.id;
+        });
+        std::vector<size_t> firsts, siblings;
+        for (size_t k = 0; k < idx.size(); ++k) {
+            bool first = k == 0 || cpus[idx[k]].core != cpus[idx[k - 1]].core;
+            (first ? firsts : siblings).push_back(idx[k]);
+        }
+        firsts.insert(firsts.end(), siblings.begin(), siblings.end());
+        return firsts;
+    }
+
+private:
+    static std::string readFile(const std::string& path) {
+        std::ifstream in(path);
+        std::string s;
+        std::getline(in, s);
+        return s;
+    }
+
+    static int readInt(const std::string& path, int fallback) {
+        std::string s = readFile(path);
+        if (s.empty()) return fallback;
+        try {
+            return std::stoi(s);
+        } catch (...) {
+            return fallback;
+        }
+    }
+
+    // "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+    static std::vector<int> parseCpuList(const std::string& s) {
+        std::vector<int> out;
+        std::stringstream ss(s);
+        std::string part;
+        while (std::getline(ss, part, ',')) {
+            if (part.empty()) continue;
+            try {
+                size_t dash = part.find('-');
+                int lo = std::stoi(part.substr(0, dash));
+                int hi = dash == std::string::npos ? lo : std::stoi(part.substr(dash + 1));
+                for (int i = lo; i <= hi; ++i) out.push_back(i);
+            } catch (...) {
+                return {};
+            }
+        }
+        return out;
+    }
+
+    static int nodeOf(const std::string& cpuDir) {
+#ifdef __linux__
+        if (DIR* d = opendir(cpuDir.c_str())) {
+            int node = 0;
+            while (dirent* e = readdir(d)) {
+                if (std::strncmp(e->d_name, "node", 4) == 0 && std::isdigit(static_cast<unsigned char>(e->d_name[4]))) {
+                    node = std::atoi(e->d_name + 4);
+                    break;
+                }
+            }
+            closedir(d);
+            return node;
+        }
+#endif
+        (void)cpuDir;
+        return 0;
+    }
+};
+
+namespace detail {
+class AtomicHistogram;
+}
+
+// Log-bucketed latency histogram in the style of HdrHistogram: every power of
+// two is split into 8 linear sub-buckets, so any recorded value is reported
+// within 12.5% while the whole int64 range fits in 496 counters. This is the
+// plain value type used for snapshots; the pool records into
+// detail::AtomicHistogram and copies out with loadInto().
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr size_t kSub = size_t(1) << kSubBits;
+    static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSub;
+
+    static size_t bucketOf(uint64_t v) {
+        if (v < kSub) return static_cast<size_t>(v);
+        int msb = highestBit(v);
+        size_t octave = static_cast<size_t>(msb - kSubBits + 1);
+        return octave * kSub + static_cast<size_t>((v >> (msb - kSubBits)) & (kSub - 1));
+    }
+
+    // Largest value that lands in bucket b.
+    static uint64_t upperBound(size_t b) {
+        size_t octave = b / kSub, sub = b % kSub;
+        if (octave == 0) return sub;
+        int shift = static_cast<int>(octave) - 1;
+        return (((kSub | sub) + 1) << shift) - 1;
+    }
+
+    void add(uint64_t v, uint64_t times = 1) {
+        counts_[bucketOf(v)] += times;
+        count_ += times;
+        sum_ += v * times;
+        max_ = std::max(max_, v);
+    }
+
+    void merge(const LatencyHistogram& o) {
+        for (size_t b = 0; b < kBuckets; ++b) counts_[b] += o.counts_[b];
+        count_ += o.count_;
+        sum_ += o.sum_;
+        max_ = std::max(max_, o.max_);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+
+    // Value at quantile q (0..1): the top of the bucket holding it, capped at max().
+    uint64_t percentile(double q) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count_) + 0.5);
+        rank = std::min(std::max<uint64_t>(rank, 1), count_);
+        uint64_t seen = 0;
+        for (size_t b = 0; b < kBuckets; ++b) {
+            seen += counts_[b];
+            if (seen >= rank) return std::min(upperBound(b), max_);
+        }
+        return max_;
+    }
+
+private:
+    friend class detail::AtomicHistogram;
+
+    static int highestBit(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(v);
+#else
+        int b = 0;
+        while (v >>= 1) ++b;
+        return b;
+#endif
+    }
+
+    std::array<uint64_t, kBuckets> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+namespace detail {
+
+// Bumps a counter that readers load concurrently. With a single writer a
+// relaxed load and store is enough and avoids a locked instruction.
+inline void bumpCounter(std::atomic<uint64_t>& c, uint64_t n, bool singleWriter) {
+    if (singleWriter) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    } else {
+        c.fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+// Recording side of LatencyHistogram: lock-free, relaxed counters. Each pool
+// worker owns one and is its only writer, so recording is plain loads and
+// stores on that worker's cache lines.
+class AtomicHistogram {
+public:
+    void record(uint64_t v, bool singleWriter = true) {
+        bumpCounter(counts_[LatencyHistogram::bucketOf(v)], 1, singleWriter);
+        bumpCounter(sum_, v, singleWriter);
+        uint64_t m = max_.load(std::memory_order_relaxed);
+        if (singleWriter) {
+            if (v > m) max_.store(v, std::memory_order_relaxed);
+        } else {
+            while (v > m && !max_.compare_exchange_weak(m, v, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    // Adds the current counts to `out`. Concurrent records may be half-visible,
+    // which is fine for monitoring.
+    void loadInto(LatencyHistogram& out) const {
+        for (size_t b = 0; b < LatencyHistogram::kBuckets; ++b) {
+            uint64_t n = counts_[b].load(std::memory_order_relaxed);
+            out.counts_[b] += n;
+            out.count_ += n;
+        }
+        out.sum_ += sum_.load(std::memory_order_relaxed);
+        out.max_ = std::max(out.max_, max_.load(std::memory_order_relaxed));
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, LatencyHistogram::kBuckets> counts_{};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+} // namespace detail
+
+// ----- Trace rings -----
+namespace detail {
+
+// The last `capacity` job events of one worker, overwritten oldest first.
+// Each slot is a tiny seqlock over relaxed atomics, so write_trace() can copy
+// events while the worker keeps recording and simply skips any slot caught
+// mid-write. The owner records with plain stores; outside threads share one
+// ring and claim slots with a fetch_add.
+class TraceRing {
+public:
+    struct Event {
+        int64_t submitNs;
+        int64_t startNs;
+        int64_t endNs;
+        const char* label;
+    };
+
+    // Capacity rounds up to a power of two; 0 records nothing.
+    void reset(size_t capacity) {
+        size_t n = 0;
+        if (capacity) {
+            n = 1;
+            while (n < capacity) n <<= 1;
+        }
+        slots_.reset(n ? new Slot[n] : nullptr);
+        mask_ = n ? n - 1 : 0;
+        head_.store(0, std::memory_order_relaxed);
+    }
+
+    void record(const Event& e, bool owner) {
+        if (!slots_) return;
+        uint64_t i = owner ? head_.load(std::memory_order_relaxed) : head_.fetch_add(1, std::memory_order_relaxed);
+        Slot& s = slots_[i & mask_];
+        s.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.submitNs.store(e.submitNs, std::memory_order_relaxed);
+        s.startNs.store(e.startNs, std::memory_order_relaxed);
+        s.endNs.store(e.endNs, std::memory_order_relaxed);
+        s.label.store(e.label, std::memory_order_relaxed);
+        s.seq.store(i + 1, std::memory_order_release);
+        if (owner) head_.store(i + 1, std::memory_order_relaxed);
+    }
+
+    // Appends the complete events still in the ring, oldest first.
+    void collect(std::vector<Event>& out) const {
+        if (!slots_) return;
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t n = mask_ + 1;
+        for (uint64_t i = head > n ? head - n : 0; i < head; ++i) {
+            const Slot& s = slots_[i & mask_];
+            uint64_t seq = s.seq.load(std::memory_order_acquire);
+            Event e{s.submitNs.load(std::memory_order_relaxed), s.startNs.load(std::memory_order_relaxed),
+                    s.endNs.load(std::memory_order_relaxed), s.label.load(std::memory_order_relaxed)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq == i + 1 && s.seq.load(std::memory_order_relaxed) == seq) out.push_back(e);
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq{0};   // index + 1 once written, 0 while being written
+        std::atomic<int64_t> submitNs{0};
+        std::atomic<int64_t> startNs{0};
+        std::atomic<int64_t> endNs{0};
+        std::atomic<const char*> label{nullptr};
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    uint64_t mask_ = 0;
+    std::atomic<uint64_t> head_{0};
+};
+
+} // namespace detail
+
+// ----- Pooled future state -----
+namespace detail {
+
+template <typename T>
+class FutureState {
+public:
+    using Stored = std::conditional_t<std::is_void_v<T>, char, T>;
+
+    // Fresh state with two references: one for the future, one for the producer.
+    static FutureState* acquire() {
+        FreeList& fl = freeList();
+        FutureState* s = fl.head;
+        if (s) {
+            fl.head = s->nextFree_;
+            --fl.count;
+        } else {
+            s = new FutureState;
+        }
+        s->refs_.store(2, std::memory_order_relaxed);
+        return s;
+    }
+
+    // Drops the future's reference. Under m_ like finish(), so whichever side
+    // comes second is the only one still touching the state when it recycles.
+    void release() {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            last = refs_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        if (last) recycle();
+    }
+
+    template <typename F>
+    void run(F& fn) {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                fn();
+                value_.emplace();
+            } else {
+                value_.emplace(fn());
+            }
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        finish();
+    }
+
+    void fail(std::exception_ptr e) {
+        error_ = std::move(e);
+        finish();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lk(m_);
+        cv_.wait(lk, [&] { return ready_; });
+    }
+
+    bool ready() {
+        std::lock_guard<std::mutex> lk(m_);
+        return ready_;
+    }
+
+    Stored take() {
+        wait();
+        if (error_) std::rethrow_exception(error_);
+        return std::move(*value_);
+    }
+
+private:
+    FutureState() = default;
+
+    struct FreeList {
+        FutureState* head = nullptr;
+        size_t count = 0;
+        ~FreeList() {
+            while (head) {
+                FutureState* n = head->nextFree_;
+                delete head;
+                head = n;
+            }
+        }
+    };
+
+    static FreeList& freeList() {
+        static thread_local FreeList fl;
+        return fl;
+    }
+
+    // Marks the state ready, wakes the waiter and drops the producer's
+    // reference in one critical section, and recycles only if that was the
+    // last one (the future was dropped without get()). A waiter cannot get
+    // past wait() before the producer lets go, so after get() the future side
+    // drops the last reference and the state goes back to the submitting
+    // thread's cache.
+    void finish() {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            ready_ = true;
+            cv_.notify_all();
+            last = refs_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        if (last) recycle();
+    }
+
+    void recycle() {
+        value_.reset();
+        error_ = nullptr;
+        ready_ = false;
+        FreeList& fl = freeList();
+        if (fl.count >= kMaxCached) {
+            delete this;
+            return;
+        }
+        nextFree_ = fl.head;
+        fl.head = this;
+        ++fl.count;
+    }
+
+    static constexpr size_t kMaxCached = 1024;
+
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool ready_ = false;
+    std::optional<Stored> value_;
+    std::exception_ptr error_;
+    std::atomic<int> refs_{0};
+    FutureState* nextFree_ = nullptr;
+};
+
+// Producer-side reference held by the queued job. If the job is destroyed without
+// running (e.g. submitted after shutdown) the future reports broken_promise instead
+// of hanging forever.
+template <typename T, typename F>
+struct FutureJob {
+    FutureState<T>* st;
+    F fn;
+
+    FutureJob(FutureState<T>* s, F&& f) : st(s), fn(std::move(f)) {}
+    FutureJob(FutureJob&& o) noexcept(std::is_nothrow_move_constructible_v<F>)
+        : st(o.st), fn(std::move(o.fn)) { o.st = nullptr; }
+    FutureJob& operator=(FutureJob&&) = delete;
+
+    void operator()() {
+        auto* s = st;
+        st = nullptr;
+        s->run(fn);
+    }
+
+    ~FutureJob() {
+        if (st) st->fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+    }
+};
+
+// Shared descriptor for parallel_for: helpers and the caller claim chunk indices
+// from one atomic counter, so splitting the range costs one fetch_add per chunk.
+template <typename Index, typename F>
+struct RangeJob {
+    RangeJob(Index b, Index e, Index g, size_t n, F&& f)
+        : begin(b), end(e), grain(g), chunks(n), fn(std::move(f)) {}
+
+    void work() {
+        size_t c;
+        while ((c = next.fetch_add(1, std::memory_order_relaxed)) < chunks) {
+            Index lo = begin + static_cast<Index>(c) * grain;
+            Index hi = (end - lo > grain) ? lo + grain : end;
+            if (!failed.load(std::memory_order_relaxed)) {
+                try {
+                    if constexpr (std::is_invocable_v<F&, Index, Index>) {
+                        fn(lo, hi);
+                    } else {
+                        for (Index i = lo; i < hi; ++i) fn(i);
+                    }
+                } catch (...) {
+                    std::lock_guard<std::mutex> lk(m);
+                    if (!error) error = std::current_exception();
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            if (done.fetch_add(1, std::memory_order_acq_rel) + 1 == chunks) {
+                std::lock_guard<std::mutex> lk(m);
+                cv.notify_all();
+            }
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk, [&] { return done.load(std::memory_order_acquire) == chunks; });
+    }
+
+    Index begin, end, grain;
+    size_t chunks;
+    F fn;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex m;
+    std::condition_variable cv;
+};
+
+// Job repeated by SimpleThreadPool::submit_every. Each firing submits a small
+// job holding a reference; a run still going when the next one is due makes
+// that one a no-op, so a slow job never overlaps itself.
+struct PeriodicJob {
+    explicit PeriodicJob(Task f) : fn(std::move(f)) {}
+
+    void run() {
+        if (running.exchange(true, std::memory_order_acquire)) return;
+        fn();
+        running.store(false, std::memory_order_release);
+    }
+
+    Task fn;
+    std::atomic<bool> running{false};
+};
+
+// An fd registered with SimpleThreadPool::watch. Readiness jobs hold a
+// reference, so one already queued or running when the watch is cancelled
+// still finishes safely.
+struct FdWatch {
+    int fd = -1;
+    uint32_t events = 0;
+    uint64_t id = 0;                 // epoll user data; 0 is the pool's eventfd
+    uint8_t prio = 0;
+    std::function<void(uint32_t)> fn;
+    bool active = true;              // under the pool's watchM_
+};
+
+// Hierarchical timing wheel (Varghese & Lauck): 4 levels of 256 slots, level
+// L slot s holding the timers whose expiry tick, shifted right by 8*L, is s.
+// A timer goes into the lowest level whose span covers its distance from
+// now, so insert and cancel are O(1) list splices; when a level wraps, the
+// next level's current slot is cascaded down. Occupancy bitmaps let
+// advance() jump straight to the next tick with work, so an idle or sparse
+// wheel costs nothing per tick. Timers further out than 2^32 ticks park in
+// the top level and are re-filed until they come into range.
+// Not thread-safe; SimpleThreadPool guards it with its timer mutex.
+class TimerWheel {
+public:
+    struct Node {
+        Task fn;                                // one-shot timers
+        std::shared_ptr<PeriodicJob> periodic;  // submit_every timers
+        uint64_t expires = 0;                   // tick
+        uint64_t period = 0;                    // ticks; 0 = one-shot
+        uint32_t gen = 0;                       // bumped on release, invalidates handles
+        uint8_t level = 0;
+        uint8_t slot = 0;
+        uint8_t prio = 0;
+        bool linked = false;
+        Node* prev = nullptr;
+        Node* next = nullptr;
+    };
+
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 8;
+    static constexpr size_t kSlots = size_t(1) << kSlotBits;
+
+    uint64_t now() const { return now_; }
+    size_t size() const { return count_; }
+
+    Node* allocate() {
+        if (!free_) {
+            nodes_.emplace_back(new Node);
+            return nodes_.back().get();
+        }
+        Node* n = free_;
+        free_ = n->next;
+        n->next = nullptr;
+        return n;
+    }
+
+    void release(Node* n) {
+        n->fn.reset();
+        n->periodic.reset();
+        ++n->gen;
+        n->next = free_;
+        free_ = n;
+    }
+
+    // Files n under n->expires; anything already due fires on the next tick.
+    void insert(Node* n) { file(n, now_ + 1); }
+
+    void unlink(Node* n) {
+        Node*& head = slots_[n->level][n->slot];
+        if (n->prev) n->prev->next = n->next;
+        else head = n->next;
+        if (n->next) n->next->prev = n->prev;
+        if (!head) occupied_[n->level][n->slot / 64] &= ~(uint64_t(1) << (n->slot % 64));
+        n->prev = n->next = nullptr;
+        n->linked = false;
+        --count_;
+    }
+
+    // Moves time forward to `target`, unlinking each expired timer and
+    // passing it to fire(Node*), which must release or re-insert it.
+    template <typename Fire>
+    void advance(uint64_t target, Fire&& fire) {
+        while (now_ < target) {
+            if (count_ == 0) {
+                now_ = target;
+                break;
+            }
+            // Next tick that either has level-0 timers or wraps level 0.
+            uint64_t toWrap = kSlots - (now_ & (kSlots - 1));
+            uint64_t step = std::min(toWrap, nextOccupied(0, now_ + 1, toWrap));
+            if (now_ + step > target) {
+                now_ = target;
+                break;
+            }
+            now_ += step;
+            for (int level = 1; level < kLevels; ++level) {
+                uint64_t below = now_ & ((uint64_t(1) << (kSlotBits * level)) - 1);
+                if (below != 0) break;
+                cascade(level);
+            }
+
+            size_t slot = now_ & (kSlots - 1);
+            while (Node* n = slots_[0][slot]) {
+                unlink(n);
+                fire(n);
+            }
+        }
+    }
+
+    // Earliest tick at which advance() might fire something: exact for level
+    // 0, the start of the next occupied slot's range for higher levels.
+    // Returns UINT64_MAX when the wheel is empty.
+    uint64_t nextExpiry() const {
+        if (count_ == 0) return UINT64_MAX;
+        uint64_t best = UINT64_MAX;
+        for (int level = 0; level < kLevels; ++level) {
+            int shift = kSlotBits * level;
+            uint64_t cur = now_ >> shift;
+            uint64_t d = nextOccupied(level, cur + 1, kSlots);
+            if (d == kSlots + 1) continue;
+            best = std::min(best, (cur + d) << shift);
+        }
+        return std::max(best, now_ + 1);
+    }
+
+private:
+    // Timers due before `earliest` are filed under it. Cascading passes now_
+    // itself, since advance() fires the current level-0 slot right after.
+    void file(Node* n, uint64_t earliest) {
+        uint64_t expires = std::max(n->expires, earliest);
+        uint64_t delta = expires - now_;
+        int level = 0;
+        while (level < kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) ++level;
+        if (level == kLevels - 1 && delta >= (uint64_t(1) << (kSlotBits * kLevels))) {
+            expires = now_ + (uint64_t(1) << (kSlotBits * kLevels)) - 1;  // out of range: re-filed later
+        }
+        size_t slot = (expires >> (kSlotBits * level)) & (kSlots - 1);
+
+        Node*& head = slots_[level][slot];
+        n->level = static_cast<uint8_t>(level);
+        n->slot = static_cast<uint8_t>(slot);
+        n->prev = nullptr;
+        n->next = head;
+        if (head) head->prev = n;
+        head = n;
+        n->linked = true;
+        occupied_[level][slot / 64] |= uint64_t(1) << (slot % 64);
+        ++count_;
+    }
+
+    // Distance (1..limit) from `from - 1` to the first occupied slot at or
+    // after `from` on `level`, or limit + 1 if none within limit slots.
+    uint64_t nextOccupied(int level, uint64_t from, uint64_t limit) const {
+        for (uint64_t d = 0; d < limit;) {
+            size_t slot = (from + d) & (kSlots - 1);
+            uint64_t word = occupied_[level][slot / 64] >> (slot % 64);
+            if (word) {
+                uint64_t hit = d + static_cast<uint64_t>(countTrailingZeros(word));
+                return hit < limit ? hit + 1 : limit + 1;
+            }
+            d += 64 - slot % 64;
+        }
+        return limit + 1;
+    }
+
+    void cascade(int level) {
+        size_t slot = (now_ >> (kSlotBits * level)) & (kSlots - 1);
+        Node* n = slots_[level][slot];
+        while (n) {
+            Node* next = n->next;
+            unlink(n);
+            file(n, now_);
+            n = next;
+        }
+    }
+
+    static int countTrailingZeros(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(v);
+#else
+        int b = 0;
+        while (!(v & 1)) {
+            v >>= 1;
+            ++b;
+        }
+        return b;
+#endif
+    }
+
+    Node* slots_[kLevels][kSlots] = {};
+    uint64_t occupied_[kLevels][kSlots / 64] = {};
+    uint64_t now_ = 0;
+    size_t count_ = 0;
+    Node* free_ = nullptr;
+    std::vector<std::unique_ptr<Node>> nodes_;
+};
+
+} // namespace detail
+
+// Move-only handle returned by SimpleThreadPool::submit_future.
+template <typename T>
+class TaskFuture {
+public:
+    TaskFuture() = default;
+    explicit TaskFuture(detail::FutureState<T>* st) : st_(st) {}
+    TaskFuture(TaskFuture&& o) noexcept : st_(o.st_) { o.st_ = nullptr; }
+    TaskFuture& operator=(TaskFuture&& o) noexcept {
+        if (this != &o) {
+            if (st_) st_->release();
+            st_ = o.st_;
+            o.st_ = nullptr;
+        }
+        return *this;
+    }
+    ~TaskFuture() {
+        if (st_) st_->release();
+    }
+
+    bool valid() const { return st_ != nullptr; }
+    bool ready() const { return st_->ready(); }
+    void wait() const { st_->wait(); }
+
+    // Blocks until the job finished; rethrows its exception. Single use.
+    T get() {
+        auto* st = st_;
+        st_ = nullptr;
+        struct Drop {
+            detail::FutureState<T>* s;
+            ~Drop() { s->release(); }
+        } drop{st};
+        if constexpr (std::is_void_v<T>) {
+            st->take();
+        } else {
+            return st->take();
+        }
+    }
+
+private:
+    detail::FutureState<T>* st_ = nullptr;
+};
+
+namespace detail {
+
+// The flag shared by a CancellationSource and its tokens. Counted intrusively
+// so a token is one pointer inside a queued job.
+struct CancelState {
+    std::atomic<bool> cancelled{false};
+    std::atomic<uint32_t> refs{1};
+
+    void retain() { refs.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+};
+
+} // namespace detail
+
+// Read side of a CancellationSource. Pass it to SimpleThreadPool::submit so
+// the job is skipped if it is cancelled while still queued; a running job can
+// poll its own copy, and cancelled() is a single atomic load. A
+// default-constructed token is never cancelled.
+class CancellationToken {
+public:
+    CancellationToken() = default;
+    CancellationToken(const CancellationToken& o) noexcept : st_(o.st_) {
+        if (st_) st_->retain();
+    }
+    CancellationToken(CancellationToken&& o) noexcept : st_(o.st_) { o.st_ = nullptr; }
+    CancellationToken& operator=(CancellationToken o) noexcept {
+        std::swap(st_, o.st_);
+        return *this;
+    }
+    ~CancellationToken() {
+        if (st_) st_->release();
+    }
+
+    bool cancelled() const noexcept {
+        return st_ && st_->cancelled.load(std::memory_order_acquire);
+    }
+
+private:
+    friend class CancellationSource;
+    explicit CancellationToken(detail::CancelState* st) noexcept : st_(st) { st_->retain(); }
+
+    detail::CancelState* st_ = nullptr;
+};
+
+// Write side. Hand out token() to every job of one request; cancel() is one
+// store however many jobs hold a token, and queued ones are dropped as workers
+// reach them. Copies share the same flag.
+class CancellationSource {
+public:
+    CancellationSource() : st_(new detail::CancelState) {}
+    CancellationSource(const CancellationSource& o) noexcept : st_(o.st_) { st_->retain(); }
+    CancellationSource& operator=(CancellationSource o) noexcept {
+        std::swap(st_, o.st_);
+        return *this;
+    }
+    ~CancellationSource() { st_->release(); }
+
+    CancellationToken token() const noexcept { return CancellationToken(st_); }
+    void cancel() noexcept { st_->cancelled.store(true, std::memory_order_release); }
+    bool cancelled() const noexcept { return st_->cancelled.load(std::memory_order_acquire); }
+
+private:
+    detail::CancelState* st_;
+};
+
+namespace detail {
+
+// A job tied to a token: checked when a worker picks it up, and destroyed
+// unrun if cancelled by then (a wrapped FutureJob then reports broken_promise).
+template <typename F>
+struct CancellableJob {
+    CancellationToken token;
+    F fn;
+
+    void operator()() {
+        if (!token.cancelled()) fn();
+    }
+};
+
+class StrandState;
+
+} // namespace detail
+
+class AsyncIo;
+
+class SimpleThreadPool {
+public:
+    // Scheduling classes for the shared queue, highest first.
+    enum class Priority { High = 0, Normal = 1, Background = 2 };
+    static constexpr size_t kLanes = 3;
+
+    struct LaneStats {
+        size_t depth = 0;        // jobs waiting in the lane right now
+        uint64_t enqueued = 0;   // total jobs ever pushed to the lane
+        size_t highWater = 0;    // deepest the lane has been (0 without metrics)
+    };
+
+    // How the shared lanes are stored. Mutex: one RingQueue per lane under m_.
+    // LockFree: one bounded MpmcQueue per lane, so submitters and workers never
+    // serialize on m_; a lane whose ring is full spills into its mutex queue.
+    enum class Backend { Mutex, LockFree };
+
+    // What a worker does when it runs out of work, before parking.
+    // Park: sleep straight away. SpinThenPark: spin spinIterations times with a
+    // pause instruction, then yield yieldIterations times, then sleep.
+    // Adaptive: like SpinThenPark, but each worker spins for about twice its
+    // recent average idle gap (EWMA) when that gap is under maxSpin, and skips
+    // spinning when jobs arrive further apart. A gap that ended in a park is
+    // measured up to the wake-up call, not to when the worker got the CPU back,
+    // so a worker that parks straight away still sees arrivals speed up and
+    // goes back to spinning. Every policy ends up parked, so an idle pool burns
+    // no CPU.
+    enum class IdlePolicy { Park, SpinThenPark, Adaptive };
+
+    // What submit() does when a bounded shared queue is full (see
+    // Options::queueCapacity).
+    // Block: wait for room. Workers never wait (they could be waiting on
+    // themselves); they run the job in place as with CallerRuns.
+    // Reject: refuse the job; submit() returns false.
+    // CallerRuns: run the job on the submitting thread before returning.
+    // DropOldest: discard the oldest queued job of the same or lower priority
+    // to make room; if every queued job outranks the new one, refuse it.
+    // Refused and discarded jobs are destroyed without running: a
+    // submit_future() future reports broken_promise and TaskGroup::wait()
+    // rethrows the same.
+    enum class Overflow { Block, Reject, CallerRuns, DropOldest };
+
+    struct QueueStats {
+        size_t capacity = 0;      // Options::queueCapacity (0 = unbounded)
+        size_t queued = 0;        // jobs in the shared lanes right now
+        size_t highWater = 0;     // most jobs the shared lanes have held at once
+        uint64_t blocked = 0;     // submits that had to wait for room
+        uint64_t rejected = 0;    // jobs refused
+        uint64_t dropped = 0;     // queued jobs discarded by DropOldest
+        uint64_t callerRuns = 0;  // jobs run by the submitter instead of queued
+    };
+
+    struct ElasticStats {
+        size_t live = 0;         // worker threads currently running
+        uint64_t spawned = 0;    // threads started after construction
+        uint64_t retired = 0;    // threads that exited after keepAlive idle
+    };
+
+    struct WorkerStats {
+        uint64_t jobs = 0;
+        uint64_t busyNs = 0;        // time spent inside jobs
+        uint64_t idleNs = 0;        // time between running dry and the next job
+        size_t dequeHighWater = 0;  // deepest this worker's deque has been
+    };
+
+    // What metrics() returns. Times are nanoseconds. Jobs run by outside
+    // threads through try_run_one() show up in the histograms but in no worker.
+    struct MetricsSnapshot {
+        LatencyHistogram queueWait;   // submit to start
+        LatencyHistogram runTime;     // start to finish
+        std::vector<WorkerStats> workers;
+        LaneStats lanes[kLanes];
+    };
+
+    struct Options {
+        size_t threads = 1;
+
+        // Elastic mode: start `threads` workers (the minimum) and add more, up to
+        // maxThreads, when a submit finds no idle worker and either the backlog
+        // exceeds growDepth jobs per live worker or nobody has picked up a job for
+        // growAfter. Workers above the minimum exit after keepAlive with no work.
+        bool elastic = false;
+        size_t maxThreads = 0;
+        size_t growDepth = 4;
+        std::chrono::microseconds growAfter{500};
+        std::chrono::milliseconds keepAlive{2000};
+
+        // Pin worker i to a CPU from CpuTopology::pinOrder() (Linux only), and
+        // make stealing and wakeups prefer workers that share a core/L2, then
+        // an L3, then a NUMA node, before going remote.
+        bool pinWorkers = false;
+
+        IdlePolicy idlePolicy = IdlePolicy::Park;
+        uint32_t spinIterations = 4000;
+        uint32_t yieldIterations = 8;
+        std::chrono::nanoseconds maxSpin{50000};
+        Backend backend = Backend::Mutex;
+        size_t ringCapacity = 4096;    // per lane, LockFree backend only
+
+        // Lanes are served in priority order, but a non-empty lane that has been
+        // passed over this many times in a row gets the next pick, so background
+        // work keeps making progress under a steady stream of high-priority jobs.
+        size_t starvationLimit = 16;
+
+        // Give every worker its own Chase-Lev deque. Jobs submitted from inside
+        // a worker land on that worker's deque; idle workers steal from a random
+        // victim. Jobs from outside the pool still go through the shared queue.
+        bool workStealing = false;
+        size_t dequeCapacity = 1024;
+
+        // Mutex backend: each time a worker takes m_ it moves up to this many
+        // jobs out of the shared lanes (fewer if that would leave other live
+        // workers less than their share) into a small per-worker buffer, so
+        // tiny jobs cost a fraction of a lock round-trip each. Other workers
+        // and try_run_one() callers steal from that buffer when they run dry,
+        // and a worker never parks or exits with jobs still in it. Opt-in: a
+        // buffered Low or Background job runs ahead of a Normal one queued
+        // after the grab (only High jumps the buffer), which undoes the
+        // lanes' ordering for up to dequeueBatch - 1 jobs per worker. 1 = pop
+        // one job per lock.
+        size_t dequeueBatch = 1;
+
+        // Opt-in: a Normal job submitted from inside a worker goes to that
+        // worker's LIFO slot and runs next, on the same core, while whatever it
+        // works on is still in cache; the job it displaces moves on to the deque
+        // or the shared queue, and only that wakes another worker. After
+        // lifoLimit slot jobs in a row the next one goes to the back of the
+        // shared queue instead, so a chain of jobs spawning each other cannot
+        // starve everything else. A slot job does not count as pending work, so
+        // idle workers park rather than wait on it; one that is awake anyway
+        // steals it once it has sat there for lifoGrace (its owner is stuck in a
+        // long job). Off by default because it changes run order: a worker's own
+        // submits overtake the shared FIFO.
+        bool lifoSlot = false;
+        uint32_t lifoLimit = 3;
+        std::chrono::nanoseconds lifoGrace{3000};
+
+        // Jobs from outside the pool always go to the shared lanes (the
+        // injection queue). A worker with local work still takes its
+        // globalQueueInterval-th job from there, so outside jobs keep moving
+        // while workers feed themselves.
+        uint32_t globalQueueInterval = 61;
+
+        // Skip waking a parked worker while another one is already awake
+        // and searching for work (spinning, or just woken): it will find the
+        // job, and if more are left it wakes one helper, which does the
+        // same. A burst of submits then costs a chain of wakeups as workers
+        // are actually needed instead of one futex wake per submit. false =
+        // wake a sleeper for every job, as before.
+        bool throttleWakeups = true;
+
+        // Own an epoll instance (Linux only) and service the fds passed to
+        // watch() from inside the pool, with no separate event-loop thread.
+        // The first worker to park waits in epoll_wait instead of on its
+        // condition variable; when an fd is ready it queues the callback as
+        // a job and, being awake already, usually runs it itself. Wakeups for
+        // that worker go through an eventfd, and other parked workers are
+        // woken before it so it keeps watching.
+        bool eventLoop = false;
+
+        // Resolution of submit_after/submit_at/submit_every. Timers never fire
+        // early; they fire up to one tick (plus wake-up latency) late.
+        std::chrono::microseconds timerTick{1000};
+
+        // Most jobs the shared lanes may hold (0 = unbounded); a submit that
+        // finds them full is handled per `overflow`. Worker deques and batch
+        // buffers are bounded separately by dequeCapacity and dequeueBatch.
+        // Timer firings and parallel_for helpers are always queued, so they
+        // may briefly take the queue over capacity.
+        size_t queueCapacity = 0;
+        Overflow overflow = Overflow::Block;
+
+        // Trace events kept per worker when built with SIMPLE_THREADPOOL_TRACE
+        // (40 bytes each; the oldest are overwritten). 0 = record nothing.
+        size_t traceEvents = 1 << 16;
+    };
+
+    // Returned by submit_after/submit_at/submit_every. Copyable; stays valid
+    // (cancel() just returns false) after the timer fired or was cancelled,
+    // for as long as the pool lives.
+    class TimerHandle {
+    public:
+        TimerHandle() = default;
+
+        // O(1). True if this stopped the timer: a one-shot job that had not been
+        // handed to the pool yet, or any further runs of a periodic one (a run
+        // already under way still finishes).
+        bool cancel() { return pool_ && pool_->cancelTimer(node_, gen_); }
+
+    private:
+        friend class SimpleThreadPool;
+        TimerHandle(SimpleThreadPool* pool, detail::TimerWheel::Node* node, uint32_t gen)
+            : pool_(pool), node_(node), gen_(gen) {}
+
+        SimpleThreadPool* pool_ = nullptr;
+        detail::TimerWheel::Node* node_ = nullptr;
+        uint32_t gen_ = 0;
+    };
+
+    // Returned by watch(). Copyable; cancel() just returns false once the
+    // watch is gone, for as long as the pool lives.
+    class WatchHandle {
+    public:
+        WatchHandle() = default;
+
+        // True if this removed the watch. A callback already queued or
+        // running still finishes; none starts after that.
+        bool cancel() { return pool_ && pool_->unwatch(id_); }
+
+    private:
+        friend class SimpleThreadPool;
+        WatchHandle(SimpleThreadPool* pool, uint64_t id) : pool_(pool), id_(id) {}
+
+        SimpleThreadPool* pool_ = nullptr;
+        uint64_t id_ = 0;
+    };
+
+    explicit SimpleThreadPool(size_t n) : SimpleThreadPool(Options{n}) {}
+
+    explicit SimpleThreadPool(const Options& opts) : opts_(opts) {
+        if (opts_.threads == 0) opts_.threads = 1;
+        size_t n = opts_.threads;
+        if (opts_.elastic) n = std::max(n, opts_.maxThreads);
+
+        if (opts_.backend == Backend::LockFree) {
+            for (Lane& lane : lanes_) lane.ring.reset(new MpmcQueue<Task>(opts_.ringCapacity));
+        }
+
+        // All worker slots exist before any thread starts so thieves can scan them freely.
+        for (size_t i = 0; i < n; ++i) {
+            slots_.emplace_back(new WorkerSlot(opts_.workStealing ? opts_.dequeCapacity : 0,
+                                               batching() ? opts_.dequeueBatch : 0, opts_.lifoSlot, i, n));
+        }
+        planPlacement();
+#if SIMPLE_THREADPOOL_TRACE
+        for (auto& slot : slots_) slot->trace.reset(opts_.traceEvents);
+        outsideTrace_.reset(opts_.traceEvents);
+#endif
+
+        if (opts_.eventLoop) openEventLoop();
+
+        // Elastic pools reserve a slot per potential worker but only start the minimum.
+        timerEpoch_ = std::chrono::steady_clock::now();
+        lastTake_.store(timerEpoch_.time_since_epoch().count());
+        workers_.resize(n);
+        std::lock_guard<std::mutex> tlk(threadsM_);
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            for (size_t i = 0; i < opts_.threads; ++i) reserveWorkerLocked(i);
+        }
+        for (size_t i = 0; i < opts_.threads; ++i) startWorker(i);
+    }
+
+    SimpleThreadPool(const SimpleThreadPool&) = delete;
+    SimpleThreadPool& operator=(const SimpleThreadPool&) = delete;
+
+    // Fire-and-forget submit. Accepts any void() callable; small captures are
+    // stored inline in the Task, so this does not allocate once the queues are warm.
+    // Only Normal jobs take the worker-local deque; other priorities always go
+    // through their shared lane so the scheduling rule sees them.
+    // Returns false if the job was not accepted: the pool is shutting down, or
+    // a bounded queue was full and Options::overflow refused it.
+    bool submit(Task job, Priority prio = Priority::Normal) {
+        unfinished_.fetch_add(1);
+#if SIMPLE_THREADPOOL_METRICS || SIMPLE_THREADPOOL_TRACE
+        job.enqueuedAt = nowNs();
+#endif
+        WorkerSlot* self = currentSlot();
+        if (self && opts_.lifoSlot && prio == Priority::Normal) {
+            // Runs next on this worker, so nobody needs waking for it; whatever
+            // was in the slot moves along and may be worth a wake-up.
+            Job* j = allocJob(*self);
+            j->fn = std::move(job);
+            j->counted = false;
+            if (Job* old = self->lifo.exchange(j, std::memory_order_acq_rel)) spillLocal(*self, old);
+            maybeGrow();
+            return true;
+        }
+        if (self && self->deque && prio == Priority::Normal) {
+            // Submitted from one of our own workers: keep it local, no lock.
+            Job* j = allocJob(*self);
+            j->fn = std::move(job);
+            if (self->deque->push(j)) {
+                noteDequeDepth(*self);
+                pending_.fetch_add(1);
+                wake();
+                maybeGrow();
+                return true;
+            }
+            job = std::move(j->fn);  // deque full: spill to the shared queue
+            releaseJob(j, self);
+        }
+        return submitShared(std::move(job), prio, self);
+    }
+
+    // As submit(), naming the job in write_trace() output. `label` is kept by
+    // pointer, so use a string literal or anything else that outlives the
+    // pool. Without SIMPLE_THREADPOOL_TRACE it is ignored.
+    bool submit(const char* label, Task job, Priority prio = Priority::Normal) {
+#if SIMPLE_THREADPOOL_TRACE
+        job.label = label;
+#else
+        (void)label;
+#endif
+        return submit(std::move(job), prio);
+    }
+
+    // Submit tied to a cancellation token: if the token is cancelled before a
+    // worker picks the job up, the job is skipped. The token adds one pointer
+    // to the job's captures.
+    template <typename F>
+    bool submit(F&& fn, CancellationToken token, Priority prio = Priority::Normal) {
+        return submit(detail::CancellableJob<std::decay_t<F>>{std::move(token), std::forward<F>(fn)}, prio);
+    }
+
+    // Submit and get the result back. The shared state comes from a per-thread
+    // freelist, so steady-state use does not allocate either (as long as the job
+    // plus one pointer fits in the Task inline buffer).
+    template <typename F, typename R = std::invoke_result_t<std::decay_t<F>&>>
+    TaskFuture<R> submit_future(F&& f, Priority prio = Priority::Normal) {
+        auto* st = detail::FutureState<R>::acquire();
+        TaskFuture<R> fut(st);
+        submit(detail::FutureJob<R, std::decay_t<F>>(st, std::decay_t<F>(std::forward<F>(f))), prio);
+        return fut;
+    }
+
+    // As above, skipped if `token` is cancelled before it starts; get() then
+    // throws std::future_error(broken_promise).
+    template <typename F, typename R = std::invoke_result_t<std::decay_t<F>&>>
+    TaskFuture<R> submit_future(F&& f, CancellationToken token, Priority prio = Priority::Normal) {
+        auto* st = detail::FutureState<R>::acquire();
+        TaskFuture<R> fut(st);
+        submit(detail::FutureJob<R, std::decay_t<F>>(st, std::decay_t<F>(std::forward<F>(f))), std::move(token), prio);
+        return fut;
+    }
+
+#ifdef SIMPLE_THREADPOOL_COROUTINES
+    // `co_await pool.schedule()` suspends the coroutine and resumes it on a pool
+    // worker (see pool_coro.h for task<T>). C++20 only. The resume job is queued
+    // like a timer firing, over any queue capacity, since a dropped one would
+    // leave the coroutine suspended for good; once the pool has shut down the
+    // coroutine just carries on in the awaiting thread.
+    auto schedule(Priority prio = Priority::Normal) {
+        struct Awaiter {
+            SimpleThreadPool* pool;
+            Priority prio;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> h) {
+                return pool->submitUnbounded([h] { h.resume(); }, prio);
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{this, prio};
+    }
+#endif
+
+    // Enqueue a whole batch with a single lock acquisition (none at all from inside
+    // a work-stealing worker) and wake at most as many sleeping workers as there
+    // are jobs. Elements of `jobs` are moved from. With a bounded queue, jobs
+    // beyond the free room go through Options::overflow one by one. Returns
+    // how many were accepted (queued or run in place).
+    template <typename Range>
+    size_t submit_bulk(Range&& jobs, Priority prio = Priority::Normal) {
+        auto it = std::begin(jobs);
+        size_t n = static_cast<size_t>(std::distance(it, std::end(jobs)));
+        return enqueueBatch(n, prio, [&it](size_t) { return Task(std::move(*it++)); });
+    }
+
+    // Runs fn over [begin, end) in chunks of `grain`. fn is called as fn(i) per
+    // index, or as fn(lo, hi) per chunk if it accepts two indices. The range is
+    // queued as one descriptor that the caller and up to size() helpers split
+    // between them. Returns once every chunk finished and rethrows the first
+    // exception fn threw.
+    template <typename Index, typename F>
+    void parallel_for(Index begin, Index end, Index grain, F&& fn) {
+        if (!(begin < end)) return;
+        if (grain < 1) grain = 1;
+        size_t chunks = static_cast<size_t>((end - begin + grain - 1) / grain);
+
+        using Range = detail::RangeJob<Index, std::decay_t<F>>;
+        auto range = std::make_shared<Range>(begin, end, grain, chunks,
+                                             std::decay_t<F>(std::forward<F>(fn)));
+        size_t helpers = std::min(chunks - 1, size());
+        enqueueBatch(helpers, Priority::Normal,
+                     [&range](size_t) { return Task([range] { range->work(); }); }, true);
+
+        range->work();
+        range->wait();
+        if (range->error) std::rethrow_exception(range->error);
+    }
+
+    // Delayed and periodic jobs. Timers live in a hierarchical timing wheel
+    // (O(1) insert and cancel) serviced by one timer thread, started on first
+    // use, that sleeps until the next expiry and submits due jobs with their
+    // priority. submit_every keeps a fixed rate from the first run; periods
+    // missed while the pool was saturated are skipped rather than bunched up,
+    // and a run never overlaps the previous one. Timers still pending at
+    // shutdown() are dropped.
+    template <typename Rep, typename Period>
+    TimerHandle submit_after(std::chrono::duration<Rep, Period> delay, Task job,
+                             Priority prio = Priority::Normal) {
+        return submit_at(std::chrono::steady_clock::now() + delay, std::move(job), prio);
+    }
+
+    TimerHandle submit_at(std::chrono::steady_clock::time_point when, Task job,
+                          Priority prio = Priority::Normal) {
+        return addTimer(when, 0, std::move(job), nullptr, prio);
+    }
+
+    template <typename Rep, typename Period>
+    TimerHandle submit_every(std::chrono::duration<Rep, Period> period, Task job,
+                             Priority prio = Priority::Normal) {
+        uint64_t ticks = std::max<uint64_t>(1, static_cast<uint64_t>(
+            std::chrono::ceil<std::chrono::steady_clock::duration>(period) / timerTick()));
+        return addTimer(std::chrono::steady_clock::now() + period, ticks, Task(),
+                        std::make_shared<detail::PeriodicJob>(std::move(job)), prio);
+    }
+
+    // fd readiness (Options::eventLoop). fn(events) runs as a job whenever
+    // `fd` reports any of `events` (EPOLLIN, EPOLLOUT, ...; level-triggered),
+    // with the epoll bits that fired. A watch never has two callbacks at
+    // once: the fd is re-armed when the callback returns, so it should read
+    // or write until EAGAIN or expect to be called again. The polling
+    // worker usually runs the callback itself, and nobody else takes over
+    // epoll_wait until a worker parks again (a hand-off would cost a wakeup
+    // per event), so keep callbacks short and submit() anything long.
+    // Returns an empty handle without an event loop or if epoll refused the
+    // fd. Cancel the watch before closing the fd.
+    template <typename F>
+    WatchHandle watch(int fd, uint32_t events, F&& fn, Priority prio = Priority::Normal) {
+#ifdef __linux__
+        if (epollFd_ < 0) return {};
+        auto w = std::make_shared<detail::FdWatch>();
+        w->fd = fd;
+        w->events = events;
+        w->prio = static_cast<uint8_t>(prio);
+        w->fn = std::forward<F>(fn);
+        // Registered under watchM_, so the poller cannot see an event for it
+        // before it is in watches_.
+        std::lock_guard<std::mutex> lk(watchM_);
+        w->id = nextWatchId_++;
+        epoll_event ev{};
+        ev.events = events | EPOLLONESHOT;
+        ev.data.u64 = w->id;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) != 0) return {};
+        uint64_t id = w->id;
+        watches_.emplace(id, std::move(w));
+        return WatchHandle(this, id);
+#else
+        (void)fd;
+        (void)events;
+        (void)fn;
+        (void)prio;
+        return {};
+#endif
+    }
+
+    // Blocks until every job submitted so far (and everything those jobs
+    // submit) has finished. The caller runs queued jobs while it waits and only
+    // sleeps once there is nothing left to pick up. Must not be called from
+    // inside a pool job, which would wait for itself.
+    void wait_idle() {
+        while (unfinished_.load() > 0) {
+            if (!try_run_one()) break;
+        }
+        idleWaiters_.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lk(m_);
+            idleCv_.wait(lk, [&] { return unfinished_.load() <= 0; });
+        }
+        idleWaiters_.fetch_sub(1);
+    }
+
+    // Runs one queued job on the calling thread, if there is one. Any thread
+    // may call this; it is how waiters help instead of blocking.
+    bool try_run_one() {
+        WorkerSlot* self = currentSlot();
+        if (Job* j = self ? popLocal(*self) : nullptr) {
+            runJob(j, self);
+            return true;
+        }
+        if (Job* j = self ? (hasLocal(*self) ? trySteal(*self) : nullptr) : stealAny()) {
+            runJob(j, self);
+            return true;
+        }
+
+        Task job;
+        static thread_local size_t outsiderSkipped[kLanes] = {};
+        if (lanes_[0].ring && popRing(self ? self->skipped : outsiderSkipped, job)) {
+            pending_.fetch_sub(1);
+        } else {
+            std::lock_guard<std::mutex> lk(m_);
+            if (!popLocked(job)) return false;
+            pending_.fetch_sub(1);
+        }
+        invoke(job, self);
+        jobDone();
+        return true;
+    }
+
+    void shutdown() {
+        stopTimers();
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stopping_ = true;
+            for (auto& slot : slots_) slot->cv.notify_one();
+            if (poller_) signalPoller();
+        }
+        {
+            // Release submitters blocked on a full queue; they return false.
+            std::lock_guard<std::mutex> lk(spaceM_);
+            spaceCv_.notify_all();
+        }
+        // Waits out a maybeGrow() that is starting a thread; any later one
+        // sees stopping_.
+        std::lock_guard<std::mutex> tlk(threadsM_);
+        for (auto& t : workers_) {
+            if (t.joinable()) t.join();
+        }
+        workers_.clear();
+    }
+
+    // Worker slots: the fixed thread count, or maxThreads for an elastic pool.
+    size_t size() const { return slots_.size(); }
+
+    ElasticStats elastic_stats() const {
+        return {live_.load(std::memory_order_relaxed), spawned_.load(std::memory_order_relaxed),
+                retired_.load(std::memory_order_relaxed)};
+    }
+
+    // Lock-free snapshot of one lane's counters.
+    LaneStats lane_stats(Priority prio) const {
+        const Lane& lane = lanes_[static_cast<size_t>(prio)];
+        return {lane.depth.load(std::memory_order_relaxed),
+                lane.enqueued.load(std::memory_order_relaxed),
+                lane.highWater.load(std::memory_order_relaxed)};
+    }
+
+    // Lock-free snapshot of the shared queue's occupancy and overflow counters.
+    // highWater is only tracked for a bounded queue; see LaneStats otherwise.
+    QueueStats queue_stats() const {
+        QueueStats st;
+        st.capacity = opts_.queueCapacity;
+        for (const Lane& lane : lanes_) st.queued += lane.depth.load(std::memory_order_relaxed);
+        st.highWater = queueHighWater_.load(std::memory_order_relaxed);
+        st.blocked = blocked_.load(std::memory_order_relaxed);
+        st.rejected = rejected_.load(std::memory_order_relaxed);
+        st.dropped = dropped_.load(std::memory_order_relaxed);
+        st.callerRuns = callerRuns_.load(std::memory_order_relaxed);
+        return st;
+    }
+
+    // Merges every worker's counters into one snapshot. Takes no lock and does
+    // not stop the workers, so counts from jobs in flight may be slightly off.
+    MetricsSnapshot metrics() const {
+        MetricsSnapshot snap;
+#if SIMPLE_THREADPOOL_METRICS
+        for (const auto& slot : slots_) {
+            const Metrics& m = slot->metrics;
+            m.queueWait.loadInto(snap.queueWait);
+            m.runTime.loadInto(snap.runTime);
+            snap.workers.push_back({m.jobs.load(std::memory_order_relaxed),
+                                    m.busyNs.load(std::memory_order_relaxed),
+                                    m.idleNs.load(std::memory_order_relaxed),
+                                    m.dequeHighWater.load(std::memory_order_relaxed)});
+        }
+        outsideMetrics_.queueWait.loadInto(snap.queueWait);
+        outsideMetrics_.runTime.loadInto(snap.runTime);
+#endif
+        for (size_t l = 0; l < kLanes; ++l) snap.lanes[l] = lane_stats(static_cast<Priority>(l));
+        return snap;
+    }
+
+    // Writes the events still in the trace rings as Chrome trace-event JSON,
+    // for Perfetto or chrome://tracing. Each worker is a track (outside
+    // threads share one) with a slice per job from start to end, plus an async
+    // "queued" slice from submit to start, so queueing, stragglers and one
+    // giant job each look different. Safe to call while the pool runs. Without
+    // SIMPLE_THREADPOOL_TRACE the trace is empty.
+    void write_trace(std::ostream& out) const {
+        std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        json += "\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"SimpleThreadPool\"}}";
+#if SIMPLE_THREADPOOL_TRACE
+        int64_t epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(timerEpoch_.time_since_epoch()).count();
+        std::vector<detail::TraceRing::Event> events;
+        uint64_t asyncId = 0;
+        for (size_t w = 0; w <= slots_.size(); ++w) {
+            bool outside = w == slots_.size();
+            std::string track = ",\"pid\":1,\"tid\":" + std::to_string(w);
+            json += ",\n{\"ph\":\"M\",\"name\":\"thread_name\"" + track + ",\"args\":{\"name\":\"" +
+                    (outside ? std::string("outside threads") : "worker " + std::to_string(w)) + "\"}}";
+
+            events.clear();
+            (outside ? outsideTrace_ : slots_[w]->trace).collect(events);
+            for (const auto& e : events) {
+                std::string name = ",\"name\":";
+                appendJsonString(name, e.label ? e.label : "job");
+                json += ",\n{\"ph\":\"X\",\"cat\":\"job\"" + name + track + ",\"ts\":";
+                appendMicros(json, e.startNs - epoch);
+                json += ",\"dur\":";
+                appendMicros(json, e.endNs - e.startNs);
+                json += "}";
+                if (e.submitNs > 0 && e.submitNs < e.startNs) {
+                    std::string id = ",\"id\":" + std::to_string(++asyncId);
+                    json += ",\n{\"ph\":\"b\",\"cat\":\"queued\"" + name + id + track + ",\"ts\":";
+                    appendMicros(json, e.submitNs - epoch);
+                    json += "},\n{\"ph\":\"e\",\"cat\":\"queued\"" + name + id + track + ",\"ts\":";
+                    appendMicros(json, e.startNs - epoch);
+                    json += "}";
+                }
+            }
+        }
+#endif
+        json += "\n]}\n";
+        out << json;
+    }
+
+    ~SimpleThreadPool() {
+        shutdown();
+        closeEventLoop();
+    }
+
+private:
+    friend class detail::StrandState;   // re-queues its drain job via submitUnbounded
+    friend class AsyncIo;               // posts I/O completions via submitUnbounded
+
+    struct WorkerSlot;
+
+    struct Lane {
+        RingQueue<Task> q;                   // mutex backend, or ring overflow
+        std::unique_ptr<MpmcQueue<Task>> ring; // LockFree backend only
+        size_t skipped = 0;                  // picks that passed this lane over; under m_
+        std::atomic<size_t> depth{0};        // q plus ring, for lock-free readers
+        std::atomic<uint64_t> enqueued{0};
+        std::atomic<size_t> highWater{0};
+    };
+
+    static void countPushed(Lane& lane, size_t n) {
+        size_t depth = lane.depth.fetch_add(n, std::memory_order_relaxed) + n;
+        lane.enqueued.fetch_add(n, std::memory_order_relaxed);
+#if SIMPLE_THREADPOOL_METRICS
+        size_t high = lane.highWater.load(std::memory_order_relaxed);
+        while (depth > high && !lane.highWater.compare_exchange_weak(high, depth, std::memory_order_relaxed)) {
+        }
+#else
+        (void)depth;
+#endif
+    }
+
+    // Per-worker instrumentation (one extra instance for outside threads).
+    struct Metrics {
+        detail::AtomicHistogram queueWait;
+        detail::AtomicHistogram runTime;
+        std::atomic<uint64_t> jobs{0};
+        std::atomic<uint64_t> busyNs{0};
+        std::atomic<uint64_t> idleNs{0};
+        std::atomic<size_t> dequeHighWater{0};   // owner writes only
+        int64_t dryAt = 0;   // owner only: when it last found no work (0 = not idle)
+    };
+
+    // Trace timestamps are microseconds with nanosecond decimals.
+    static void appendMicros(std::string& out, int64_t ns) {
+        if (ns < 0) ns = 0;
+        out += std::to_string(ns / 1000);
+        char frac[5] = {'.', char('0' + ns / 100 % 10), char('0' + ns / 10 % 10), char('0' + ns % 10), 0};
+        out += frac;
+    }
+
+    static void appendJsonString(std::string& out, const char* s) {
+        out += '"';
+        for (; *s; ++s) {
+            unsigned char c = static_cast<unsigned char>(*s);
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += static_cast<char>(c);
+            } else if (c < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 15];
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+        out += '"';
+    }
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Runs a dequeued job; with metrics on, also records its queue wait and run
+    // time and closes the worker's idle interval, and with tracing on, logs
+    // its event. `self` is null for outside threads.
+    void invoke(Task& job, WorkerSlot* self) {
+#if SIMPLE_THREADPOOL_METRICS || SIMPLE_THREADPOOL_TRACE
+        int64_t start = nowNs();
+        job();
+        int64_t end = nowNs();
+        // Workers own their Metrics and trace ring; outside threads share one
+        // of each and need atomic adds.
+        bool owner = self != nullptr;
+#endif
+#if SIMPLE_THREADPOOL_METRICS
+        Metrics& m = self ? self->metrics : outsideMetrics_;
+        if (owner && m.dryAt) {
+            detail::bumpCounter(m.idleNs, static_cast<uint64_t>(start - m.dryAt), true);
+            m.dryAt = 0;
+        }
+        m.queueWait.record(static_cast<uint64_t>(std::max<int64_t>(start - job.enqueuedAt, 0)), owner);
+        uint64_t ran = static_cast<uint64_t>(end - start);
+        m.runTime.record(ran, owner);
+        detail::bumpCounter(m.busyNs, ran, owner);
+        detail::bumpCounter(m.jobs, 1, owner);
+#endif
+#if SIMPLE_THREADPOOL_TRACE
+        (self ? self->trace : outsideTrace_).record({job.enqueuedAt, start, end, job.label}, owner);
+#endif
+#if !SIMPLE_THREADPOOL_METRICS && !SIMPLE_THREADPOOL_TRACE
+        (void)self;
+        job();
+#endif
+    }
+
+    void noteDry(WorkerSlot& self) {
+#if SIMPLE_THREADPOOL_METRICS
+        if (!self.metrics.dryAt) self.metrics.dryAt = nowNs();
+#else
+        (void)self;
+#endif
+    }
+
+    static void noteDequeDepth(WorkerSlot& self) {
+#if SIMPLE_THREADPOOL_METRICS
+        size_t depth = self.deque->size();
+        if (depth > self.metrics.dequeHighWater.load(std::memory_order_relaxed)) {
+            self.metrics.dequeHighWater.store(depth, std::memory_order_relaxed);
+        }
+#else
+        (void)self;
+#endif
+    }
+
+    void pushLocked(Task&& job, Priority prio) {
+        Lane& lane = lanes_[static_cast<size_t>(prio)];
+        lane.q.push(std::move(job));
+        countPushed(lane, 1);
+    }
+
+    // Queues one job, already counted in unfinished_, on its shared lane.
+    // `unbounded` skips the capacity check (timers, parallel_for helpers).
+    bool submitShared(Task&& job, Priority prio, WorkerSlot* self, bool unbounded = false) {
+        if (bounded()) {
+            if (unbounded) {
+                forceSlots(1);
+            } else {
+                switch (admit(job, prio, self)) {
+                case Admit::Queue:
+                    break;
+                case Admit::Ran:
+                    return true;
+                case Admit::Refused:
+                    job.reset();   // a future or TaskGroup job reports itself broken
+                    jobDone();
+                    return false;
+                }
+            }
+        }
+
+        Lane& lane = lanes_[static_cast<size_t>(prio)];
+        if (lane.ring && !stopping_.load() && lane.ring->try_push(std::move(job))) {
+            countPushed(lane, 1);
+            pending_.fetch_add(1);
+            wake();
+            maybeGrow();
+            return true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            if (!stopping_) {
+                pushLocked(std::move(job), prio);
+                pending_.fetch_add(1);
+                wakeLocked(1);
+            }
+        }
+        if (job) {   // shut down under us
+            releaseSlots(1);
+            job.reset();
+            jobDone();   // a wait_idle() counting this job must hear it is gone
+            return false;
+        }
+        maybeGrow();
+        return true;
+    }
+
+    bool bounded() const { return opts_.queueCapacity > 0; }
+
+    enum class Admit { Queue, Ran, Refused };
+
+    // Bounded queue: claims a slot for `job`, or applies the overflow policy
+    // when the lanes are full. On Ran the job has already run and finished.
+    Admit admit(Task& job, Priority prio, WorkerSlot* self) {
+        if (stopping_.load()) return Admit::Refused;
+        if (reserveSlots(1)) return Admit::Queue;
+
+        Overflow policy = opts_.overflow;
+        if (policy == Overflow::Block && self) policy = Overflow::CallerRuns;
+        switch (policy) {
+        case Overflow::Block:
+            blocked_.fetch_add(1, std::memory_order_relaxed);
+            if (waitForSlot()) return Admit::Queue;
+            break;
+        case Overflow::CallerRuns: {
+            callerRuns_.fetch_add(1, std::memory_order_relaxed);
+            struct Done {
+                SimpleThreadPool* pool;
+                ~Done() { pool->jobDone(); }
+            } done{this};
+            invoke(job, self);
+            return Admit::Ran;
+        }
+        case Overflow::DropOldest:
+            if (evictOldest(prio) || reserveSlots(1)) return Admit::Queue;
+            break;
+        case Overflow::Reject:
+            break;
+        }
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return Admit::Refused;
+    }
+
+    // Claims up to n queue slots and returns how many it got.
+    size_t reserveSlots(size_t n) {
+        size_t cur = occupancy_.load();
+        for (;;) {
+            size_t take = std::min(n, opts_.queueCapacity - std::min(cur, opts_.queueCapacity));
+            if (take == 0) return 0;
+            if (occupancy_.compare_exchange_weak(cur, cur + take)) {
+                noteOccupancy(cur + take);
+                return take;
+            }
+        }
+    }
+
+    void forceSlots(size_t n) {
+        noteOccupancy(occupancy_.fetch_add(n) + n);
+    }
+
+    void noteOccupancy(size_t occupied) {
+        size_t high = queueHighWater_.load(std::memory_order_relaxed);
+        while (occupied > high &&
+               !queueHighWater_.compare_exchange_weak(high, occupied, std::memory_order_relaxed)) {
+        }
+    }
+
+    // A job left the shared lanes. Wakes one blocked submitter per freed slot,
+    // never all of them. Pairs with waitForSlot: either the submitter's
+    // re-check sees the lower occupancy, or we see it counted as blocked.
+    void releaseSlots(size_t n) {
+        if (!bounded() || n == 0) return;
+        occupancy_.fetch_sub(n);
+        if (blockedSubmitters_.load() == 0) return;
+        std::lock_guard<std::mutex> lk(spaceM_);
+        for (size_t i = 0; i < n; ++i) spaceCv_.notify_one();
+    }
+
+    // Overflow::Block. False if the pool shut down first.
+    bool waitForSlot() {
+        bool got = false;
+        blockedSubmitters_.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lk(spaceM_);
+            spaceCv_.wait(lk, [&] { return (got = reserveSlots(1) == 1) || stopping_.load(); });
+        }
+        blockedSubmitters_.fetch_sub(1);
+        return got;
+    }
+
+    // Overflow::DropOldest: discards the front job of the lowest non-empty lane
+    // no more important than `prio`; its slot passes to the caller.
+    bool evictOldest(Priority prio) {
+        Task victim;
+        for (size_t l = kLanes; !victim && l-- > static_cast<size_t>(prio);) {
+            Lane& lane = lanes_[l];
+            if (lane.depth.load(std::memory_order_relaxed) == 0) continue;
+            if (!lane.ring || !lane.ring->try_pop(victim)) {
+                std::lock_guard<std::mutex> lk(m_);
+                if (lane.q.empty()) continue;
+                victim = std::move(lane.q.front());
+                lane.q.pop();
+            }
+            lane.depth.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (!victim) return false;
+        pending_.fetch_sub(1);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        victim.reset();   // outside m_: destroying it may run user code
+        jobDone();
+        return true;
+    }
+
+    // LockFree backend: same priority/starvation rule as popLocked, but with the
+    // pass-over counters kept per worker since there is no lock to share them under.
+    bool popRing(size_t (&skipped)[kLanes], Task& out) {
+        // Starved lanes first, then everything else in priority order.
+        auto starved = [&](size_t l) { return l > 0 && skipped[l] >= opts_.starvationLimit; };
+        size_t order[kLanes];
+        size_t k = 0;
+        for (size_t l = 0; l < kLanes; ++l) {
+            if (starved(l)) order[k++] = l;
+        }
+        for (size_t l = 0; l < kLanes; ++l) {
+            if (!starved(l)) order[k++] = l;
+        }
+
+        for (size_t i = 0; i < kLanes; ++i) {
+            size_t l = order[i];
+            Lane& lane = lanes_[l];
+            if (lane.depth.load(std::memory_order_relaxed) == 0 || !lane.ring->try_pop(out)) continue;
+            lane.depth.fetch_sub(1, std::memory_order_relaxed);
+            releaseSlots(1);
+            for (size_t lower = l + 1; lower < kLanes; ++lower) {
+                if (lanes_[lower].depth.load(std::memory_order_relaxed) > 0) ++skipped[lower];
+            }
+            skipped[l] = 0;
+            return true;
+        }
+        return false;
+    }
+
+    bool sharedEmptyLocked() const {
+        for (const Lane& lane : lanes_) {
+            if (!lane.q.empty()) return false;
+        }
+        return true;
+    }
+
+    // Strict priority order, except that a lane passed over starvationLimit times
+    // in a row is served next. Caller holds m_.
+    bool popLocked(Task& out) {
+        size_t chosen = kLanes;
+        for (size_t l = 1; l < kLanes; ++l) {
+            if (!lanes_[l].q.empty() && lanes_[l].skipped >= opts_.starvationLimit) {
+                chosen = l;
+                break;
+            }
+        }
+        if (chosen == kLanes) {
+            for (size_t l = 0; l < kLanes; ++l) {
+                if (!lanes_[l].q.empty()) {
+                    chosen = l;
+                    break;
+                }
+            }
+        }
+        if (chosen == kLanes) return false;
+
+        for (size_t l = chosen + 1; l < kLanes; ++l) {
+            if (!lanes_[l].q.empty()) ++lanes_[l].skipped;
+        }
+        Lane& lane = lanes_[chosen];
+        lane.skipped = 0;
+        out = std::move(lane.q.front());
+        lane.q.pop();
+        lane.depth.fetch_sub(1, std::memory_order_relaxed);
+        releaseSlots(1);
+        return true;
+    }
+
+    bool highPriorityWaiting() const {
+        return lanes_[0].depth.load(std::memory_order_relaxed) > 0;
+    }
+
+    // Deque entry. Nodes are recycled through their owner's freelists.
+    struct Job {
+        Task fn;
+        WorkerSlot* owner = nullptr;
+        Job* next = nullptr;
+        bool counted = true;   // in pending_; a job in a LIFO slot is not
+    };
+
+    struct WorkerSlot {
+        WorkerSlot(size_t dequeCapacity, size_t batchCapacity, bool lifoSlot, size_t id, size_t workers)
+            : deque(dequeCapacity ? new WorkStealingDeque<Job*>(dequeCapacity) : nullptr),
+              batch(batchCapacity ? new WorkStealingDeque<Job*>(batchCapacity) : nullptr),
+              rng(static_cast<uint32_t>(id) * 2654435761u + 1) {
+            // A worker never has more nodes outstanding than a full deque, batch
+            // and slot, one being pushed, and one running on every worker, so
+            // preallocate exactly that.
+            size_t local = dequeCapacity + batchCapacity + (lifoSlot ? 1 : 0);
+            size_t nodes = local ? local + workers + 1 : 0;
+            if (batch) grabbed.reserve(batchCapacity);
+            for (size_t i = 0; i < nodes; ++i) {
+                allJobs.emplace_back(new Job);
+                allJobs.back()->owner = this;
+                allJobs.back()->next = freeJobs;
+                freeJobs = allJobs.back().get();
+            }
+        }
+
+        std::unique_ptr<WorkStealingDeque<Job*>> deque;
+        std::unique_ptr<WorkStealingDeque<Job*>> batch;   // see Options::dequeueBatch
+        std::vector<Job*> grabbed;                         // scratch for grabBatchLocked
+        std::atomic<Job*> lifo{nullptr};                   // see Options::lifoSlot
+        uint32_t lifoRuns = 0;      // owner only: slot jobs run back to back
+        uint32_t sinceGlobal = 0;   // owner only: local picks since the last shared one
+        uint32_t rng;  // xorshift state for victim selection
+        size_t skipped[kLanes] = {};  // popRing's pass-over counters
+
+        // Adaptive idle policy: when this worker last ran dry, its smoothed idle
+        // gap, and when a waker last claimed it while parked (under m_).
+        std::chrono::steady_clock::time_point idleSince{};
+        int64_t idleEwmaNs = 0;
+        std::chrono::steady_clock::time_point wokenAt{};
+
+        Job* freeJobs = nullptr;                   // owner only
+        std::atomic<Job*> remoteFree{nullptr};     // returned by thieves
+        std::vector<std::unique_ptr<Job>> allJobs; // owner only; frees nodes at teardown
+
+        // Placement: the CPU this worker is pinned to (-1 = unpinned), and the
+        // other workers ordered nearest first, split into equal-distance tiers
+        // (nearby[tierEnds[k-1] .. tierEnds[k])).
+        int cpu = -1;
+        std::vector<size_t> nearby;
+        std::vector<size_t> tierEnds;
+
+        // Each worker parks on its own condition variable (under m_) so a
+        // waker can pick which sleeper to rouse.
+        std::condition_variable cv;
+        bool parked = false;
+        bool searching = false; // counted in searching_; owner, or a waker under m_ while parked
+        bool running = false;   // a thread owns, or is being started for, this slot; under m_
+
+#if SIMPLE_THREADPOOL_METRICS
+        Metrics metrics;
+#endif
+#if SIMPLE_THREADPOOL_TRACE
+        detail::TraceRing trace;
+#endif
+    };
+
+    // Caller holds m_. Claims slot i for a thread startWorker() is about to
+    // create.
+    void reserveWorkerLocked(size_t i) {
+        slots_[i]->running = true;
+        live_.fetch_add(1);
+    }
+
+    // Caller holds threadsM_ but not m_, so neither the clone nor joining the
+    // slot's previous occupant (which has already left workerLoop) stalls
+    // submitters and workers.
+    void startWorker(size_t i) {
+        if (workers_[i].joinable()) workers_[i].join();
+        workers_[i] = std::thread([this, i] { workerLoop(i); });
+    }
+
+    // Elastic mode: called after every enqueue. Cheap unless no worker is idle.
+    // One thread starts at a time; submitters that find one being started
+    // carry on rather than queue up behind it.
+    void maybeGrow() {
+        if (!opts_.elastic || idle_.load() > 0 || live_.load() >= slots_.size()) return;
+        int64_t backlog = pending_.load();
+        if (backlog <= 0) return;
+        bool deep = backlog > static_cast<int64_t>(opts_.growDepth * live_.load());
+        bool stalled = std::chrono::steady_clock::now().time_since_epoch().count() - lastTake_.load(std::memory_order_relaxed) >
+                       std::chrono::duration_cast<std::chrono::steady_clock::duration>(opts_.growAfter).count();
+        if (!deep && !stalled) return;
+
+        std::unique_lock<std::mutex> tlk(threadsM_, std::try_to_lock);
+        if (!tlk) return;
+        size_t i = 0;
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            if (stopping_ || idle_.load() > 0) return;
+            while (i < slots_.size() && slots_[i]->running) ++i;
+            if (i == slots_.size()) return;
+            reserveWorkerLocked(i);
+        }
+        startWorker(i);
+        spawned_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Fill in each slot's cpu/nearby/tierEnds. Without pinning every other
+    // worker is equally far away.
+    void planPlacement() {
+        size_t n = slots_.size();
+        CpuTopology topo;
+        std::vector<size_t> order;
+        if (opts_.pinWorkers) {
+            topo = CpuTopology::detect();
+            order = topo.pinOrder();
+        }
+        auto cpuOf = [&](size_t w) -> const CpuTopology::Cpu* {
+            return order.empty() ? nullptr : &topo.cpus[order[w % order.size()]];
+        };
+
+        for (size_t i = 0; i < n; ++i) {
+            WorkerSlot& s = *slots_[i];
+            if (const auto* c = cpuOf(i)) s.cpu = c->id;
+
+            std::vector<std::pair<int, size_t>> byDistance;
+            for (size_t j = 0; j < n; ++j) {
+                if (j == i) continue;
+                int d = cpuOf(i) ? CpuTopology::distance(*cpuOf(i), *cpuOf(j)) : 0;
+                byDistance.emplace_back(d, j);
+            }
+            std::stable_sort(byDistance.begin(), byDistance.end(),
+                             [](const auto& a, const auto& b) { return a.first < b.first; });
+            for (size_t k = 0; k < byDistance.size(); ++k) {
+                s.nearby.push_back(byDistance[k].second);
+                if (k + 1 == byDistance.size() || byDistance[k + 1].first != byDistance[k].first) {
+                    s.tierEnds.push_back(s.nearby.size());
+                }
+            }
+        }
+    }
+
+    static void pinCurrentThread(int cpu) {
+#ifdef __linux__
+        if (cpu < 0) return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)cpu;
+#endif
+    }
+
+    // Which pool/slot the calling thread belongs to (nullptr for outside threads).
+    static inline thread_local SimpleThreadPool* tlsPool_ = nullptr;
+    static inline thread_local WorkerSlot* tlsSlot_ = nullptr;
+
+    WorkerSlot* currentSlot() const {
+        return tlsPool_ == this ? tlsSlot_ : nullptr;
+    }
+
+    // Wake up to `count` sleeping workers. Pairs with the idle_ increment in
+    // workerLoop: either the sleeper sees our pending_ bump in its predicate,
+    // or we see it idle and notify.
+    void wake(size_t count = 1) {
+        if (count == 0 || idle_.load() == 0) return;
+        if (opts_.throttleWakeups && searching_.load() >= count) return;
+        std::lock_guard<std::mutex> lk(m_);
+        wakeLocked(count);
+    }
+
+    // Caller holds m_. A worker wakes its nearest parked peers first so the
+    // job it just queued is stolen by someone sharing its caches; outside
+    // threads rotate through the pool. Workers already searching count
+    // towards `count`; each one woken here starts out searching. Pairs with
+    // stopSearching: either a searcher's re-check sees our pending_ bump, or
+    // we see it searching and leave the job to it. The event-loop poller is
+    // woken last, through its eventfd, so it goes on watching fds while
+    // anyone else can take the job.
+    void wakeLocked(size_t count) {
+        if (idle_.load() == 0) return;
+        if (opts_.throttleWakeups) {
+            size_t searching = searching_.load();
+            if (searching >= count) return;
+            count -= searching;
+        }
+        auto claim = [&](WorkerSlot& s) {
+            s.parked = false;
+            if (opts_.idlePolicy == IdlePolicy::Adaptive) s.wokenAt = std::chrono::steady_clock::now();
+            idle_.fetch_sub(1);  // no longer available, even before it gets the CPU
+            if (!s.searching) {
+                s.searching = true;
+                searching_.fetch_add(1);
+            }
+            --count;
+        };
+        auto tryWake = [&](WorkerSlot& s) {
+            if (!s.parked || &s == poller_) return;
+            claim(s);
+            s.cv.notify_one();
+        };
+        if (WorkerSlot* self = currentSlot()) {
+            for (size_t k = 0; k < self->nearby.size() && count > 0; ++k) tryWake(*slots_[self->nearby[k]]);
+        } else {
+            size_t n = slots_.size();
+            size_t start = wakeCursor_++;
+            for (size_t k = 0; k < n && count > 0; ++k) tryWake(*slots_[(start + k) % n]);
+        }
+        if (count > 0 && poller_ && poller_->parked) {
+            claim(*poller_);
+            signalPoller();
+        }
+    }
+
+    // Enqueue `n` tasks produced by make(i): onto our own deque when called from
+    // a work-stealing worker, the rest into the shared lane under one lock. With
+    // a bounded queue, only as many as there is room for go in together; the
+    // rest are admitted one at a time. Returns how many were accepted.
+    template <typename Make>
+    size_t enqueueBatch(size_t n, Priority prio, Make&& makeTask, bool unbounded = false) {
+        unfinished_.fetch_add(static_cast<int64_t>(n));
+#if SIMPLE_THREADPOOL_METRICS || SIMPLE_THREADPOOL_TRACE
+        int64_t now = nowNs();
+        auto make = [&makeTask, now](size_t k) {
+            Task t = makeTask(k);
+            t.enqueuedAt = now;
+            return t;
+        };
+#else
+        auto& make = makeTask;
+#endif
+        size_t i = 0, local = 0;
+        Task spill;
+        WorkerSlot* self = currentSlot();
+        if (self && self->deque && prio == Priority::Normal) {
+            for (; i < n; ++i) {
+                Job* j = allocJob(*self);
+                j->fn = make(i);
+                if (!self->deque->push(j)) {
+                    spill = std::move(j->fn);  // deque full
+                    releaseJob(j, self);
+                    ++i;
+                    break;
+                }
+                ++local;
+            }
+            noteDequeDepth(*self);
+            pending_.fetch_add(static_cast<int64_t>(local));
+        }
+
+        // Jobs [i, end) plus `spill` have a queue slot each; `overflow` (if
+        // set) and [end, n) still need one.
+        size_t end = n, reserved = 0;
+        Task overflow;
+        if (bounded()) {
+            size_t want = n - i + (spill ? 1 : 0);
+            if (unbounded) {
+                forceSlots(want);
+                reserved = want;
+            } else {
+                reserved = reserveSlots(want);
+            }
+            if (spill && reserved == 0) overflow = std::move(spill);
+            end = i + reserved - (spill ? 1 : 0);
+        }
+
+        size_t ringed = 0;
+        Lane& lane = lanes_[static_cast<size_t>(prio)];
+        if (lane.ring && !stopping_.load()) {
+            if (!spill && i < end) spill = make(i++);
+            while (spill && lane.ring->try_push(std::move(spill))) {
+                ++ringed;
+                spill = i < end ? make(i++) : Task();
+            }
+            countPushed(lane, ringed);
+            pending_.fetch_add(static_cast<int64_t>(ringed));
+        }
+
+        size_t shared = 0;
+        if (spill || i < end) {
+            std::lock_guard<std::mutex> lk(m_);
+            if (!stopping_) {
+                if (spill) {
+                    pushLocked(std::move(spill), prio);
+                    ++shared;
+                }
+                for (; i < end; ++i, ++shared) pushLocked(make(i), prio);
+                pending_.fetch_add(static_cast<int64_t>(shared));
+            }
+        }
+        if (bounded()) releaseSlots(reserved - std::min(reserved, ringed + shared));   // shut down under us
+        wake(local + ringed + shared);   // before anything below waits for room
+
+        // submitShared settles unfinished_ for these itself.
+        size_t overflowed = 0, accepted = 0;
+        if (overflow) {
+            ++overflowed;
+            accepted += submitShared(std::move(overflow), prio, self);
+        }
+        if (end < n && !stopping_.load()) {
+            for (i = end; i < n; ++i, ++overflowed) accepted += submitShared(make(i), prio, self);
+        }
+
+        if (size_t dropped = n - local - ringed - shared - overflowed) jobDone(static_cast<int64_t>(dropped));
+        maybeGrow();
+        return local + ringed + shared + accepted;
+    }
+
+    static Job* allocJob(WorkerSlot& s) {
+        if (!s.freeJobs) s.freeJobs = s.remoteFree.exchange(nullptr, std::memory_order_acquire);
+        if (Job* j = s.freeJobs) {
+            s.freeJobs = j->next;
+            j->counted = true;
+            return j;
+        }
+        s.allJobs.emplace_back(new Job);
+        s.allJobs.back()->owner = &s;
+        return s.allJobs.back().get();
+    }
+
+    static void releaseJob(Job* j, WorkerSlot* self) {
+        j->fn.reset();
+        WorkerSlot* owner = j->owner;
+        if (owner == self) {
+            j->next = owner->freeJobs;
+            owner->freeJobs = j;
+            return;
+        }
+        // Push-only Treiber stack; the owner takes it wholesale, so no ABA.
+        Job* head = owner->remoteFree.load(std::memory_order_relaxed);
+        do {
+            j->next = head;
+        } while (!owner->remoteFree.compare_exchange_weak(head, j, std::memory_order_release,
+                                                          std::memory_order_relaxed));
+    }
+
+    static uint32_t nextRandom(uint32_t& s) {
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        return s;
+    }
+
+    // Outside threads (try_run_one) steal from any worker's deque.
+    Job* stealAny() {
+        if (!opts_.workStealing && !batching() && !opts_.lifoSlot) return nullptr;
+        static thread_local uint32_t rng = 0x9e3779b9u;
+        size_t n = slots_.size();
+        size_t start = nextRandom(rng) % n;
+        for (size_t k = 0; k < n; ++k) {
+            if (Job* j = stealFrom(*slots_[(start + k) % n])) return j;
+        }
+        if (opts_.lifoSlot) {
+            for (size_t k = 0; k < n; ++k) {
+                if (Job* j = stealSlot(*slots_[(start + k) % n])) return j;
+            }
+        }
+        return nullptr;
+    }
+
+    static Job* stealFrom(WorkerSlot& victim) {
+        if (victim.deque) {
+            if (Job* j = victim.deque->steal()) return j;
+        }
+        return victim.batch ? victim.batch->steal() : nullptr;
+    }
+
+    // A slot job normally runs on its owner moments after it was put there;
+    // take it only if it is still the same job after lifoGrace.
+    Job* stealSlot(WorkerSlot& victim) {
+        Job* j = victim.lifo.load(std::memory_order_relaxed);
+        if (!j) return nullptr;
+        auto deadline = std::chrono::steady_clock::now() + opts_.lifoGrace;
+        do {
+            std::this_thread::yield();   // let the owner have the CPU if we share one
+            if (victim.lifo.load(std::memory_order_relaxed) != j) return nullptr;
+        } while (std::chrono::steady_clock::now() < deadline);
+        return victim.lifo.compare_exchange_strong(j, nullptr, std::memory_order_acq_rel) ? j : nullptr;
+    }
+
+    // Slot first (the job the last one just spawned), then the own deque
+    // (newest, cache-hot), then jobs this worker batched out of the shared
+    // lanes. Past lifoLimit slot jobs in a row, the slot job goes to the back
+    // of the shared queue instead.
+    Job* popLocal(WorkerSlot& self) {
+        Job* j = self.lifo.load(std::memory_order_relaxed) ? self.lifo.exchange(nullptr, std::memory_order_acq_rel)
+                                                           : nullptr;
+        if (j && ++self.lifoRuns > opts_.lifoLimit) {
+            self.lifoRuns = 0;
+            Task job = std::move(j->fn);
+            releaseJob(j, &self);
+            requeueOwned(std::move(job));
+            j = nullptr;
+        } else if (!j) {
+            self.lifoRuns = 0;
+        }
+        if (!j && self.deque) j = self.deque->pop();
+        if (!j && self.batch) j = self.batch->pop();
+        return j;
+    }
+
+    // A job pushed out of the slot: onto the deque, or the shared lane when
+    // there is none (or it is full). Either way it now counts as pending and
+    // another worker may take it, so this is where the slot path wakes one.
+    void spillLocal(WorkerSlot& self, Job* j) {
+        j->counted = true;
+        if (self.deque && self.deque->push(j)) {
+            noteDequeDepth(self);
+            pending_.fetch_add(1);
+            wake();
+            return;
+        }
+        Task job = std::move(j->fn);
+        releaseJob(j, &self);
+        requeueOwned(std::move(job));
+    }
+
+    // Moves a job out of this worker's LIFO slot to the back of the Normal
+    // lane, where it starts counting in pending_. It was accepted when
+    // submitted, so unlike submitShared() this ignores capacity and
+    // stopping_: shutdown() still drains it instead of dropping a job
+    // submit() said it took.
+    void requeueOwned(Task&& job) {
+        if (bounded()) forceSlots(1);
+        Lane& lane = lanes_[static_cast<size_t>(Priority::Normal)];
+        if (lane.ring && lane.ring->try_push(std::move(job))) {
+            countPushed(lane, 1);
+            pending_.fetch_add(1);
+            wake();
+            return;
+        }
+        std::lock_guard<std::mutex> lk(m_);
+        pushLocked(std::move(job), Priority::Normal);
+        pending_.fetch_add(1);
+        wakeLocked(1);
+    }
+
+    // Every globalQueueInterval-th pick looks at the shared lanes first. Jobs
+    // already moved from them into self.batch count as theirs: popLocal()
+    // serves the deque first, so a worker feeding itself would strand them.
+    bool globalTurn(WorkerSlot& self) {
+        if (++self.sinceGlobal < opts_.globalQueueInterval) return false;
+        self.sinceGlobal = 0;
+        if (self.batch && self.batch->size() > 0) return true;
+        for (const Lane& lane : lanes_) {
+            if (lane.depth.load(std::memory_order_relaxed) > 0) return true;
+        }
+        return false;
+    }
+
+    bool hasLocal(const WorkerSlot& self) const {
+        return self.deque || self.batch || opts_.lifoSlot;
+    }
+
+    bool batching() const {
+        return opts_.dequeueBatch > 1 && opts_.backend == Backend::Mutex;
+    }
+
+    // Caller holds m_ and has just popped one job to run. Moves up to
+    // dequeueBatch - 1 more into self.batch, leaving the rest of the backlog
+    // to the other live workers. The jobs stay counted in pending_, like deque
+    // jobs, so idle workers keep looking (and steal them) instead of parking.
+    void grabBatchLocked(WorkerSlot& self) {
+        size_t queued = 0;
+        for (const Lane& lane : lanes_) queued += lane.q.size();
+        size_t room = opts_.dequeueBatch - 1 - std::min(opts_.dequeueBatch - 1, self.batch->size());
+        size_t share = queued / std::max<size_t>(live_.load(), 1);
+        size_t take = std::min(room, share);
+        if (take == 0) return;
+
+        self.grabbed.clear();
+        Task job;
+        while (self.grabbed.size() < take && popLocked(job)) {
+            Job* j = allocJob(self);
+            j->fn = std::move(job);
+            self.grabbed.push_back(j);
+        }
+        // The owner pops from the bottom, so push in reverse to keep FIFO order.
+        for (auto it = self.grabbed.rbegin(); it != self.grabbed.rend(); ++it) self.batch->push(*it);
+    }
+
+    void runJob(Job* j, WorkerSlot* self) {
+        if (j->counted) pending_.fetch_sub(1);
+        invoke(j->fn, self);
+        releaseJob(j, self);
+        jobDone();
+    }
+
+    // Every job that ran (or was dropped) ends here, `n` at a time for jobs a
+    // batch never queued; the last one out wakes wait_idle() callers.
+    void jobDone(int64_t n = 1) {
+        if (unfinished_.fetch_sub(n) == n && idleWaiters_.load() > 0) {
+            std::lock_guard<std::mutex> lk(m_);
+            idleCv_.notify_all();
+        }
+    }
+
+    // Nearest tier first; random start within a tier so thieves spread out.
+    Job* trySteal(WorkerSlot& self) {
+        size_t begin = 0;
+        for (size_t end : self.tierEnds) {
+            size_t width = end - begin;
+            size_t start = nextRandom(self.rng) % width;
+            for (size_t k = 0; k < width; ++k) {
+                size_t victim = self.nearby[begin + (start + k) % width];
+                if (Job* j = stealFrom(*slots_[victim])) return j;
+            }
+            begin = end;
+        }
+        if (opts_.lifoSlot) {
+            for (size_t victim : self.nearby) {
+                if (Job* j = stealSlot(*slots_[victim])) return j;
+            }
+        }
+        return nullptr;
+    }
+
+    // Searching: awake, without a job, and looking for one. Submitters skip
+    // waking sleepers while anyone is (see Options::throttleWakeups).
+    void startSearching(WorkerSlot& self) {
+        if (self.searching) return;
+        self.searching = true;
+        searching_.fetch_add(1);
+    }
+
+    // Found a job (or about to park, with handOff false). The last searcher
+    // to find one wakes a single helper if more jobs are waiting, so work
+    // discovered in a burst fans out one worker at a time. Not under m_.
+    void stopSearching(WorkerSlot& self, bool handOff = true) {
+        if (!self.searching) return;
+        self.searching = false;
+        if (searching_.fetch_sub(1) == 1 && handOff && pending_.load() > 0) wake();
+    }
+
+    // Spin/yield per opts_.idlePolicy until work shows up, counted as
+    // searching. Returns false when the budget ran out and the caller should
+    // park.
+    bool spinForWork(WorkerSlot& self) {
+        using Clock = std::chrono::steady_clock;
+        auto hasWork = [&] { return pending_.load(std::memory_order_relaxed) > 0 || stopping_.load(); };
+
+        if (opts_.idlePolicy == IdlePolicy::Park) return false;
+        if (opts_.idlePolicy == IdlePolicy::Adaptive) {
+            if (self.idleSince == Clock::time_point{}) self.idleSince = Clock::now();
+            int64_t window = 2 * self.idleEwmaNs;
+            if (window > opts_.maxSpin.count()) return false;  // arrivals too sparse to be worth it
+            startSearching(self);
+            auto deadline = self.idleSince + std::chrono::nanoseconds(window);
+            for (uint32_t i = 0;; ++i) {
+                if (hasWork()) return true;
+                cpuRelax();
+                if ((i & 63) == 63 && Clock::now() >= deadline) break;
+            }
+        } else {
+            startSearching(self);
+            for (uint32_t i = 0; i < opts_.spinIterations; ++i) {
+                if (hasWork()) return true;
+                cpuRelax();
+            }
+        }
+        for (uint32_t i = 0; i < opts_.yieldIterations; ++i) {
+            if (hasWork()) return true;
+            std::this_thread::yield();
+        }
+        return false;
+    }
+
+    // Bookkeeping when a worker picks up a job: elastic mode records when the
+    // queue last moved; the adaptive idle policy folds the gap since this
+    // worker ran dry into its EWMA. If it parked, the gap ends when it was
+    // woken, leaving out the futex wake-up (tens of us) that would otherwise
+    // keep it parking for good; samples are capped at maxSpin, which is all
+    // it takes to stop spinning.
+    void noteWork(WorkerSlot& self) {
+        using Clock = std::chrono::steady_clock;
+        if (opts_.elastic) lastTake_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        if (opts_.idlePolicy != IdlePolicy::Adaptive || self.idleSince == Clock::time_point{}) return;
+        Clock::time_point end = self.wokenAt > self.idleSince ? self.wokenAt : Clock::now();
+        int64_t gap = std::chrono::duration_cast<std::chrono::nanoseconds>(end - self.idleSince).count();
+        gap = std::min<int64_t>(gap, opts_.maxSpin.count());
+        self.idleEwmaNs += (gap - self.idleEwmaNs) / 8;
+        self.idleSince = Clock::time_point{};
+        self.wokenAt = Clock::time_point{};
+    }
+
+    // ----- Timers (all under timerM_) -----
+    std::chrono::steady_clock::duration timerTick() const {
+        return std::max<std::chrono::steady_clock::duration>(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(opts_.timerTick),
+            std::chrono::steady_clock::duration(1));
+    }
+
+    // First tick at or after `when`, so a timer never fires early.
+    uint64_t tickAt(std::chrono::steady_clock::time_point when) const {
+        if (when <= timerEpoch_) return 0;
+        auto tick = timerTick();
+        return static_cast<uint64_t>((when - timerEpoch_ + tick - std::chrono::steady_clock::duration(1)) / tick);
+    }
+
+    uint64_t currentTick() const {
+        return static_cast<uint64_t>((std::chrono::steady_clock::now() - timerEpoch_) / timerTick());
+    }
+
+    TimerHandle addTimer(std::chrono::steady_clock::time_point when, uint64_t periodTicks, Task job,
+                         std::shared_ptr<detail::PeriodicJob> periodic, Priority prio) {
+        std::lock_guard<std::mutex> lk(timerM_);
+        if (timersStopped_) return {};
+        if (!timerThread_.joinable()) timerThread_ = std::thread([this] { timerLoop(); });
+
+        detail::TimerWheel::Node* n = wheel_.allocate();
+        n->fn = std::move(job);
+        n->periodic = std::move(periodic);
+        n->expires = tickAt(when);
+        n->period = periodTicks;
+        n->prio = static_cast<uint8_t>(prio);
+        wheel_.insert(n);
+        if (n->expires < timerWakeTick_) timerCv_.notify_one();   // sooner than it planned to wake
+        return TimerHandle(this, n, n->gen);
+    }
+
+    bool cancelTimer(detail::TimerWheel::Node* n, uint32_t gen) {
+        std::lock_guard<std::mutex> lk(timerM_);
+        if (n->gen != gen || !n->linked) return false;
+        wheel_.unlink(n);
+        wheel_.release(n);
+        return true;
+    }
+
+    void fireTimer(detail::TimerWheel::Node* n) {
+        Priority prio = static_cast<Priority>(n->prio);
+        if (n->period) {
+            submitUnbounded([job = n->periodic] { job->run(); }, prio);
+            uint64_t behind = wheel_.now() - n->expires;   // whole periods missed
+            n->expires += (behind / n->period + 1) * n->period;
+            wheel_.insert(n);
+            return;
+        }
+        Task job = std::move(n->fn);
+        wheel_.release(n);
+        submitUnbounded(std::move(job), prio);
+    }
+
+    // Queued even over a bounded capacity, never run inline: the timer thread
+    // holds timerM_ and must neither wait for room nor run jobs itself, and a
+    // strand's drain job must not be lost or the strand would stall.
+    bool submitUnbounded(Task job, Priority prio) {
+        unfinished_.fetch_add(1);
+#if SIMPLE_THREADPOOL_METRICS || SIMPLE_THREADPOOL_TRACE
+        job.enqueuedAt = nowNs();
+#endif
+        return submitShared(std::move(job), prio, nullptr, true);
+    }
+
+    void timerLoop() {
+        std::unique_lock<std::mutex> lk(timerM_);
+        while (!timersStopped_) {
+            wheel_.advance(currentTick(), [this](detail::TimerWheel::Node* n) { fireTimer(n); });
+            timerWakeTick_ = wheel_.nextExpiry();
+            if (timerWakeTick_ == UINT64_MAX) {
+                timerCv_.wait(lk);
+            } else {
+                timerCv_.wait_until(lk, timerEpoch_ + timerTick() * static_cast<int64_t>(timerWakeTick_));
+            }
+        }
+    }
+
+    void stopTimers() {
+        {
+            std::lock_guard<std::mutex> lk(timerM_);
+            timersStopped_ = true;
+            timerCv_.notify_one();
+        }
+        if (timerThread_.joinable()) timerThread_.join();
+    }
+
+    // ----- Event loop (Options::eventLoop) -----
+    // Without epoll (or if it cannot be set up) epollFd_ stays -1 and every
+    // worker parks on its condition variable as usual.
+    void openEventLoop() {
+#ifdef __linux__
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = 0;
+        if (epollFd_ < 0 || wakeFd_ < 0 || epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev) != 0) closeEventLoop();
+#endif
+    }
+
+    void closeEventLoop() {
+#ifdef __linux__
+        if (epollFd_ >= 0) ::close(epollFd_);
+        if (wakeFd_ >= 0) ::close(wakeFd_);
+#endif
+        epollFd_ = wakeFd_ = -1;
+    }
+
+    // Caller holds m_. The eventfd stays readable until the poller drains
+    // it, so a signal sent before it reaches epoll_wait is not lost.
+    void signalPoller() {
+#ifdef __linux__
+        uint64_t one = 1;
+        ssize_t r = ::write(wakeFd_, &one, sizeof(one));
+        (void)r;   // EAGAIN: already signalled
+#endif
+    }
+
+    // Caller holds m_ and is poller_, parked. Waits in epoll_wait with the
+    // lock released, then queues a job per ready watch and wakes helpers for
+    // all but the one it will run itself. Returns false on an elastic
+    // keepAlive timeout.
+    bool pollLocked(std::unique_lock<std::mutex>& lk, std::chrono::steady_clock::time_point deadline) {
+#ifdef __linux__
+        int timeoutMs = -1;
+        if (opts_.elastic) {
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) return false;
+            timeoutMs = static_cast<int>(std::min<int64_t>(left.count(), int64_t(1) << 30));
+        }
+        epoll_event events[kPollEvents];
+        lk.unlock();
+        int n = epoll_wait(epollFd_, events, kPollEvents, timeoutMs);
+        lk.lock();
+        if (n == 0) return false;
+        size_t queued = 0;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u64 == 0) {
+                uint64_t v;
+                ssize_t r = ::read(wakeFd_, &v, sizeof(v));
+                (void)r;
+            } else if (queueWatchLocked(events[i].data.u64, events[i].events)) {
+                ++queued;
+            }
+        }
+        if (queued > 1) wakeLocked(queued - 1);
+#else
+        (void)lk;
+        (void)deadline;
+#endif
+        return true;
+    }
+
+    // Caller holds m_ (lock order: m_ before watchM_). Queued like a timer
+    // firing, over a bounded capacity: epoll has already disarmed the fd, so
+    // a refused job would silence it for good.
+    bool queueWatchLocked(uint64_t id, uint32_t events) {
+        if (stopping_) return false;
+        std::shared_ptr<detail::FdWatch> w;
+        {
+            std::lock_guard<std::mutex> wl(watchM_);
+            auto it = watches_.find(id);
+            if (it == watches_.end()) return false;   // cancelled since epoll_wait returned
+            w = it->second;
+        }
+        Priority prio = static_cast<Priority>(w->prio);
+        Task job([this, w = std::move(w), events] {
+            w->fn(events);
+            rearm(*w);
+        });
+#if SIMPLE_THREADPOOL_METRICS || SIMPLE_THREADPOOL_TRACE
+        job.enqueuedAt = nowNs();
+#endif
+        unfinished_.fetch_add(1);
+        if (bounded()) forceSlots(1);
+        pushLocked(std::move(job), prio);
+        pending_.fetch_add(1);
+        return true;
+    }
+
+    void rearm(const detail::FdWatch& w) {
+#ifdef __linux__
+        std::lock_guard<std::mutex> lk(watchM_);
+        if (!w.active) return;
+        epoll_event ev{};
+        ev.events = w.events | EPOLLONESHOT;
+        ev.data.u64 = w.id;
+        epoll_ctl(epollFd_, EPOLL_CTL_MOD, w.fd, &ev);
+#else
+        (void)w;
+#endif
+    }
+
+    bool unwatch(uint64_t id) {
+        std::lock_guard<std::mutex> lk(watchM_);
+        auto it = watches_.find(id);
+        if (it == watches_.end()) return false;
+        it->second->active = false;
+#ifdef __linux__
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, it->second->fd, nullptr);
+#endif
+        watches_.erase(it);
+        return true;
+    }
+
+    void workerLoop(size_t workerId) {
+        WorkerSlot& self = *slots_[workerId];
+        tlsPool_ = this;
+        tlsSlot_ = &self;
+        pinCurrentThread(self.cpu);
+        self.idleEwmaNs = opts_.maxSpin.count() / 4;  // start out willing to spin
+
+        while (true) {
+            // Local work first, unless a high-priority job is waiting in the
+            // shared lane or it is the shared lanes' turn (which jobs batched
+            // out of them take first).
+            if (hasLocal(self) && !highPriorityWaiting()) {
+                Job* j = nullptr;
+                if (!globalTurn(self)) {
+                    j = popLocal(self);
+                    if (!j) j = trySteal(self);
+                } else if (self.batch) {
+                    j = self.batch->pop();
+                }
+                if (j) {
+                    stopSearching(self);
+                    noteWork(self);
+                    runJob(j, &self);
+                    continue;
+                }
+            }
+
+            Task job;
+
+            if (lanes_[0].ring && popRing(self.skipped, job)) {
+                pending_.fetch_sub(1);
+                stopSearching(self);
+                noteWork(self);
+                invoke(job, &self);
+                jobDone();
+                continue;
+            }
+
+            // Our own slot job is not in pending_, so never spin, park or
+            // exit past it (a global turn or a High job can skip the local pop).
+            bool slotted = self.lifo.load(std::memory_order_relaxed) != nullptr;
+
+            if (pending_.load() <= 0 && !stopping_ && !slotted) {
+                noteDry(self);
+                if (spinForWork(self)) continue;
+            }
+
+            {
+                std::unique_lock<std::mutex> lk(m_);
+                if (sharedEmptyLocked() && !stopping_ && !slotted) {
+                    noteDry(self);
+                    stopSearching(self, false);   // before the ready() re-check below
+                    self.parked = true;
+                    idle_.fetch_add(1);
+                    auto ready = [&] { return stopping_ || pending_.load() > 0; };
+                    auto deadline = std::chrono::steady_clock::now() + opts_.keepAlive;
+                    bool woke = true;
+                    while (!ready()) {
+                        if (!self.parked) {
+                            // Signalled, but another worker took the job first. The
+                            // waker already dropped us from idle_, so advertise
+                            // ourselves again before re-checking, or no later wake
+                            // would ever find us.
+                            stopSearching(self, false);
+                            self.parked = true;
+                            idle_.fetch_add(1);
+                            continue;
+                        }
+                        if (epollFd_ >= 0 && (!poller_ || poller_ == &self)) {
+                            poller_ = &self;
+                            bool polled = pollLocked(lk, deadline);
+                            poller_ = nullptr;
+                            if (!polled) {
+                                woke = ready();
+                                break;
+                            }
+                        } else if (!opts_.elastic) {
+                            self.cv.wait(lk);
+                        } else if (self.cv.wait_until(lk, deadline) == std::cv_status::timeout) {
+                            woke = ready();
+                            break;
+                        }
+                    }
+                    if (self.parked) {  // timeout, stop or spurious wake: nobody un-idled us
+                        self.parked = false;
+                        idle_.fetch_sub(1);
+                    }
+
+                    // Idle for a whole keepAlive and above the minimum: retire.
+                    if (!woke && live_.load() > opts_.threads) {
+                        stopSearching(self, false);
+                        self.running = false;
+                        live_.fetch_sub(1);
+                        retired_.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+                }
+
+                if (popLocked(job)) {
+                    pending_.fetch_sub(1);
+                    if (self.batch) grabBatchLocked(self);
+                } else if (stopping_ && pending_.load() == 0 && !slotted) {
+                    stopSearching(self, false);
+                    return;
+                }
+            }
+
+            // Run outside lock
+            if (job) {
+                stopSearching(self);
+                noteWork(self);
+                invoke(job, &self);
+                jobDone();
+            }
+        }
+    }
+
+private:
+    Options opts_;
+    std::vector<std::unique_ptr<WorkerSlot>> slots_;
+    std::vector<std::thread> workers_;   // under threadsM_
+    std::mutex threadsM_;                // taken before m_, never under it
+    Lane lanes_[kLanes];
+    std::mutex m_;
+    size_t wakeCursor_ = 0;   // under m_
+    std::atomic<bool> stopping_{false};
+
+    // Jobs sitting in a lane or any worker deque; idle workers sleep only when this is zero.
+    std::atomic<int64_t> pending_{0};
+    std::atomic<size_t> idle_{0};   // parked workers nobody has signalled yet
+    std::atomic<size_t> searching_{0};   // awake workers looking for a job (Options::throttleWakeups)
+
+    // Jobs submitted but not yet finished (queued or running), for wait_idle().
+    std::atomic<int64_t> unfinished_{0};
+    std::atomic<size_t> idleWaiters_{0};
+    std::condition_variable idleCv_;   // under m_
+
+    // Bounded queue (Options::queueCapacity). occupancy_ counts claimed slots:
+    // it goes up before a job is pushed and down after it is popped, so it
+    // never undercounts the lanes. Blocked submitters wait on spaceCv_.
+    std::atomic<size_t> occupancy_{0};
+    std::atomic<size_t> queueHighWater_{0};
+    std::atomic<size_t> blockedSubmitters_{0};
+    std::mutex spaceM_;
+    std::condition_variable spaceCv_;
+    std::atomic<uint64_t> blocked_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> callerRuns_{0};
+
+    // Elastic mode bookkeeping.
+    std::atomic<size_t> live_{0};
+    std::atomic<uint64_t> spawned_{0};
+    std::atomic<uint64_t> retired_{0};
+    std::atomic<int64_t> lastTake_{0};   // steady_clock ticks of the last job pickup
+
+#if SIMPLE_THREADPOOL_METRICS
+    Metrics outsideMetrics_;   // jobs run by try_run_one() callers
+#endif
+#if SIMPLE_THREADPOOL_TRACE
+    detail::TraceRing outsideTrace_;
+#endif
+
+    // Timers. Lock order: timerM_ before m_ (fireTimer submits under it).
+    std::mutex timerM_;
+    std::condition_variable timerCv_;
+    std::thread timerThread_;
+    detail::TimerWheel wheel_;
+    std::chrono::steady_clock::time_point timerEpoch_;   // tick 0
+    uint64_t timerWakeTick_ = UINT64_MAX;                // when timerLoop next wakes
+    bool timersStopped_ = false;
+
+    // Event loop. poller_ is the parked worker in epoll_wait, under m_.
+    // Lock order: m_ before watchM_.
+    static constexpr int kPollEvents = 64;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;   // eventfd, epoll user data 0
+    WorkerSlot* poller_ = nullptr;
+    std::mutex watchM_;
+    std::unordered_map<uint64_t, std::shared_ptr<detail::FdWatch>> watches_;
+    uint64_t nextWatchId_ = 1;
+};
+
+// A batch of jobs that can be waited on together. Outstanding work is one
+// atomic counter that starts at 1 (the waiter's own reference), so jobs
+// finishing before wait() never touch anything but that counter; only the job
+// that completes after the waiter dropped its reference takes the lock.
+//
+// run() may be called from outside threads before wait(), or from the group's
+// own jobs at any time. The first exception thrown by a job is rethrown from
+// wait().
+class TaskGroup {
+public:
+    explicit TaskGroup(SimpleThreadPool& pool,
+                       SimpleThreadPool::Priority prio = SimpleThreadPool::Priority::Normal)
+        : pool_(pool), prio_(prio) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    ~TaskGroup() {
+        // Never leave jobs pointing at a dead group.
+        try {
+            wait();
+        } catch (...) {
+        }
+    }
+
+    // The job plus one pointer must fit SIMPLE_THREADPOOL_TASK_INLINE to stay allocation-free.
+    template <typename F>
+    void run(F&& fn) {
+        count_.fetch_add(1, std::memory_order_relaxed);
+        pool_.submit(Job<std::decay_t<F>>(this, std::decay_t<F>(std::forward<F>(fn))), prio_);
+    }
+
+    // Runs queued pool jobs on this thread until the group drains, then blocks
+    // only if some of its jobs are still running elsewhere.
+    void wait() {
+        while (count_.load(std::memory_order_acquire) > 1) {
+            if (!pool_.try_run_one()) break;
+        }
+        if (count_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            std::unique_lock<std::mutex> lk(m_);
+            cv_.wait(lk, [&] { return done_; });
+        }
+        // Re-arm for the next batch.
+        done_ = false;
+        count_.store(1, std::memory_order_relaxed);
+
+        std::exception_ptr e;
+        std::swap(e, error_);
+        if (e) std::rethrow_exception(e);
+    }
+
+    // Jobs queued or running (approximate while they are in flight).
+    size_t outstanding() const {
+        return count_.load(std::memory_order_relaxed) - 1;
+    }
+
+private:
+    // Like FutureJob: if the pool destroys it unrun (shut down, or refused or
+    // dropped by a bounded queue), it still counts as finished, with a
+    // broken_promise error, so wait() does not hang.
+    template <typename F>
+    struct Job {
+        TaskGroup* group;
+        F fn;
+
+        Job(TaskGroup* g, F&& f) : group(g), fn(std::move(f)) {}
+        Job(Job&& o) noexcept(std::is_nothrow_move_constructible_v<F>)
+            : group(o.group), fn(std::move(o.fn)) { o.group = nullptr; }
+        Job& operator=(Job&&) = delete;
+
+        void operator()() {
+            TaskGroup* g = group;
+            group = nullptr;
+            try {
+                fn();
+            } catch (...) {
+                g->fail(std::current_exception());
+            }
+            g->finishOne();
+        }
+
+        ~Job() {
+            if (!group) return;
+            group->fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+            group->finishOne();
+        }
+    };
+
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> lk(m_);
+        if (!error_) error_ = std::move(e);
+    }
+
+    void finishOne() {
+        if (count_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        // Last one after the waiter let go: the waiter cannot return (and destroy
+        // us) until it sees done_ under the lock we are holding.
+        std::lock_guard<std::mutex> lk(m_);
+        done_ = true;
+        cv_.notify_one();
+    }
+
+    SimpleThreadPool& pool_;
+    SimpleThreadPool::Priority prio_;
+    std::atomic<size_t> count_{1};
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool done_ = false;
+    std::exception_ptr error_;
+};
+
+// Producer-side batching for threads outside the pool. Each producer thread
+// gets its own buffer on first submit(); jobs collect there and go to the pool
+// in one submit_bulk() (one m_ acquisition) once `batch` have built up, when
+// the producer calls flush(), or at the latest `maxDelay` after the oldest one
+// was buffered, enforced by a small flusher thread that sleeps while every
+// buffer is empty. A buffer's own mutex is only ever shared with the flusher,
+// so producers no longer contend with each other.
+//
+// Batching is for throughput: a job may sit in a buffer for up to maxDelay
+// (plus timer wake-up latency) before any worker can see it. submit() cannot
+// report a job the pool refuses at flush time (a bounded queue under
+// Overflow::Reject, or a pool that has shut down); rejected() counts them.
+class SubmitBatcher {
+public:
+    struct Options {
+        size_t batch = 64;
+        std::chrono::microseconds maxDelay{100};
+        SimpleThreadPool::Priority prio = SimpleThreadPool::Priority::Normal;
+    };
+
+    explicit SubmitBatcher(SimpleThreadPool& pool) : SubmitBatcher(pool, Options{}) {}
+
+    SubmitBatcher(SimpleThreadPool& pool, const Options& opts)
+        : pool_(pool), opts_(opts), id_(nextId()) {
+        if (opts_.batch == 0) opts_.batch = 1;
+        flusher_ = std::thread([this] { flusherLoop(); });
+    }
+
+    SubmitBatcher(const SubmitBatcher&) = delete;
+    SubmitBatcher& operator=(const SubmitBatcher&) = delete;
+
+    // Producers must be done submitting; anything still buffered is flushed.
+    ~SubmitBatcher() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        flusher_.join();
+        flush_all();
+    }
+
+    template <typename F>
+    void submit(F&& fn) {
+        Buffer& b = local();
+        bool first;
+        std::vector<Task> full;
+        {
+            std::lock_guard<std::mutex> lk(b.m);
+            first = b.jobs.empty();
+            if (first) b.oldest = std::chrono::steady_clock::now();
+            b.jobs.emplace_back(std::forward<F>(fn));
+            if (b.jobs.size() >= opts_.batch) {
+                full = takeLocked(b);
+                first = false;
+            }
+        }
+        if (!full.empty()) {
+            submitTaken(b, full);
+            return;
+        }
+        // A sleeping flusher has no deadline to wake up for; give it one.
+        if (first && flusherIdle_.load()) {
+            std::lock_guard<std::mutex> lk(m_);
+            kicked_ = true;
+            cv_.notify_one();
+        }
+    }
+
+    // Hands the calling thread's buffered jobs to the pool now.
+    void flush() {
+        Buffer& b = local();
+        std::vector<Task> jobs;
+        {
+            std::lock_guard<std::mutex> lk(b.m);
+            if (b.jobs.empty()) return;
+            jobs = takeLocked(b);
+        }
+        submitTaken(b, jobs);
+    }
+
+    // Flushes every producer's buffer.
+    void flush_all() {
+        std::vector<std::pair<Buffer*, std::vector<Task>>> taken;
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            for (auto& b : buffers_) {
+                std::lock_guard<std::mutex> blk(b->m);
+                if (!b->jobs.empty()) taken.emplace_back(b.get(), takeLocked(*b));
+            }
+        }
+        for (auto& t : taken) submitTaken(*t.first, t.second);
+    }
+
+    // Jobs the pool refused when their buffer was flushed.
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+
+private:
+    struct Buffer {
+        std::mutex m;
+        std::vector<Task> jobs;                       // under m; keeps its capacity
+        std::vector<Task> spare[2];                   // under m; capacity for the next batches
+        std::chrono::steady_clock::time_point oldest; // under m; when jobs went non-empty
+    };
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> ids{0};
+        return ++ids;
+    }
+
+    struct CacheEntry {
+        uint64_t id;
+        Buffer* buffer;              // valid while the batcher with this id lives
+        std::weak_ptr<Buffer> alive; // expires when that batcher is destroyed
+    };
+
+    // This thread's buffer, created and registered on first use. The
+    // thread-local cache is keyed by id_ rather than `this`, so a batcher
+    // allocated where a dead one used to be never picks up its stale entry.
+    // A miss first prunes entries of batchers destroyed since, so a thread
+    // that outlives many batchers only scans the ones still alive.
+    Buffer& local() {
+        static thread_local std::vector<CacheEntry> cache;
+        for (auto& entry : cache) {
+            if (entry.id == id_) return *entry.buffer;
+        }
+        cache.erase(std::remove_if(cache.begin(), cache.end(),
+                                   [](const CacheEntry& e) { return e.alive.expired(); }),
+                    cache.end());
+        std::lock_guard<std::mutex> lk(m_);
+        buffers_.push_back(std::make_shared<Buffer>());
+        Buffer* b = buffers_.back().get();
+        b->jobs.reserve(opts_.batch);
+        cache.push_back(CacheEntry{id_, b, buffers_.back()});
+        return *b;
+    }
+
+    // Caller holds b.m. Takes the buffered jobs, leaving b a spare vector's
+    // capacity to fill next. Lock order is m_, then a buffer's m; neither is
+    // held while calling into the pool, which may block (Overflow::Block) or
+    // run a job that submits here again (CallerRuns).
+    std::vector<Task> takeLocked(Buffer& b) {
+        std::vector<Task> jobs = std::move(b.jobs);
+        for (auto& spare : b.spare) {
+            if (spare.capacity() > 0) {
+                b.jobs = std::move(spare);
+                break;
+            }
+        }
+        b.jobs.reserve(opts_.batch);   // allocates only if both spares are out
+        return jobs;
+    }
+
+    // With no lock held: submits jobs taken from b, then hands their capacity
+    // back to b. The producer and the flusher can each have a batch out at
+    // once, so two spares keep a busy buffer allocation-free.
+    void submitTaken(Buffer& b, std::vector<Task>& jobs) {
+        if (jobs.empty()) return;
+        size_t n = jobs.size();
+        size_t accepted = pool_.submit_bulk(jobs, opts_.prio);
+        if (accepted < n) rejected_.fetch_add(n - accepted, std::memory_order_relaxed);
+        jobs.clear();
+        std::lock_guard<std::mutex> lk(b.m);
+        for (auto& spare : b.spare) {
+            if (spare.capacity() == 0) {
+                spare = std::move(jobs);
+                break;
+            }
+        }
+    }
+
+    // Flushes buffers whose oldest job is due and sleeps until the next one
+    // is. Timed waits tend to oversleep, so deadlines are brought forward by a
+    // running average (EWMA) of how late recent wake-ups were. With nothing
+    // buffered it sleeps until a producer kicks it.
+    void flusherLoop() {
+        using Clock = std::chrono::steady_clock;
+        std::chrono::nanoseconds lateEwma{0};
+        std::unique_lock<std::mutex> lk(m_);
+        while (!stop_) {
+            // Announce idleness before scanning: a producer that fills a buffer
+            // after we looked at it is then guaranteed to see the flag.
+            flusherIdle_.store(true);
+            auto now = Clock::now();
+            auto next = Clock::time_point::max();
+            for (auto& b : buffers_) {
+                std::lock_guard<std::mutex> blk(b->m);
+                if (b->jobs.empty()) continue;
+                auto due = b->oldest + opts_.maxDelay - lateEwma;
+                if (due <= now) {
+                    due_.emplace_back(b.get(), takeLocked(*b));
+                } else {
+                    next = std::min(next, due);
+                }
+            }
+            if (!due_.empty()) {
+                // Submit with no lock held, then look again: more may be due.
+                lk.unlock();
+                for (auto& d : due_) submitTaken(*d.first, d.second);
+                due_.clear();
+                lk.lock();
+                continue;
+            }
+            if (next != Clock::time_point::max()) {
+                flusherIdle_.store(false);
+                cv_.wait_until(lk, next, [&] { return stop_; });
+                auto late = std::max(Clock::now() - next, Clock::duration::zero());
+                lateEwma += (std::chrono::duration_cast<std::chrono::nanoseconds>(late) - lateEwma) / 8;
+            } else {
+                cv_.wait(lk, [&] { return stop_ || kicked_; });
+                kicked_ = false;
+            }
+        }
+    }
+
+    SimpleThreadPool& pool_;
+    Options opts_;
+    const uint64_t id_;
+
+    std::mutex m_;   // buffers_, kicked_, stop_
+    std::condition_variable cv_;
+    std::vector<std::shared_ptr<Buffer>> buffers_; // the only owners; caches hold weak_ptrs
+    bool kicked_ = false;
+    bool stop_ = false;
+    std::atomic<bool> flusherIdle_{false};
+    std::atomic<uint64_t> rejected_{0};
+    std::vector<std::pair<Buffer*, std::vector<Task>>> due_;   // flusher thread only
+    std::thread flusher_;
+};
@@ -0,0 +1,889 @@
+// Throughput benchmarks for SimpleThreadPool.
+// Build: g++ -std=c++17 -O2 -pthread threadpool_bench.cpp -o threadpool_bench
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+#include "strand.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Every heap allocation in the process goes through here so benchmarks can
+// assert on allocations per submit.
+// (Kept out of line so GCC does not pair an inlined free() with operator new.)
+static std::atomic<long> g_allocs{0};
+
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(std::size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+BENCH_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Tiny amount of work so scheduling overhead dominates.
+static void spinWork(int iters) {
+    volatile int x = 0;
+    for (int i = 0; i < iters; ++i) x = x + i;
+}
+
+static void waitFor(const std::atomic<long>& done, long target) {
+    while (done.load(std::memory_order_acquire) < target) std::this_thread::yield();
+}
+
+// ----- Fork/join fan-out: every job spawns children from inside the pool -----
+static void spawnTree(SimpleThreadPool& pool, std::atomic<long>& done, int depth) {
+    spinWork(200);
+    if (depth > 0) {
+        for (int c = 0; c < 4; ++c) {
+            pool.submit([&pool, &done, depth] { spawnTree(pool, done, depth - 1); });
+        }
+    }
+    done.fetch_add(1, std::memory_order_release);
+}
+
+static double benchFanOut(size_t threads, bool stealing, bool pinned = false) {
+    const int depth = 8;                    // 4^0 + ... + 4^8 = 87381 jobs
+    long total = 0;
+    for (int d = 0, w = 1; d <= depth; ++d, w *= 4) total += w;
+
+    SimpleThreadPool::Options opts;
+    opts.threads = threads;
+    opts.workStealing = stealing;
+    opts.pinWorkers = pinned;
+    // The baseline is the plain single queue: one pop per lock, no LIFO slot.
+    opts.dequeueBatch = 1;
+    opts.lifoSlot = false;
+    SimpleThreadPool pool(opts);
+
+    std::atomic<long> done{0};
+    auto t0 = Clock::now();
+    pool.submit([&] { spawnTree(pool, done, depth); });
+    waitFor(done, total);
+    double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    return total / secs;
+}
+
+// ----- Fan-out of many tiny items from one producer -----
+static void benchBatch(size_t threads) {
+    const int items = 10000;
+    const int batches = 50;
+    SimpleThreadPool pool(threads);
+    std::atomic<long> done{0};
+    std::vector<Task> batch;
+    batch.reserve(items);
+
+    auto time = [&](auto&& body) {
+        auto t0 = Clock::now();
+        for (int b = 0; b < batches; ++b) body();
+        return std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / batches;
+    };
+
+    double loop = time([&] {
+        long before = done.load();
+        for (int i = 0; i < items; ++i) pool.submit([&done] { spinWork(50); done.fetch_add(1); });
+        waitFor(done, before + items);
+    });
+    double bulk = time([&] {
+        long before = done.load();
+        batch.clear();
+        for (int i = 0; i < items; ++i) batch.emplace_back([&done] { spinWork(50); done.fetch_add(1); });
+        pool.submit_bulk(batch);
+        waitFor(done, before + items);
+    });
+    double pfor = time([&] {
+        pool.parallel_for(0, items, 64, [](int) { spinWork(50); });
+    });
+
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(0)
+              << std::setw(14) << loop << std::setw(14) << bulk << std::setw(14) << pfor << "\n";
+}
+
+// ----- Short-task latency behind a deep background backlog -----
+static void benchPriority(bool useLanes) {
+    using Prio = SimpleThreadPool::Priority;
+    SimpleThreadPool pool(4);
+    std::atomic<long> done{0};
+
+    const int backlog = 5000;
+    for (int i = 0; i < backlog; ++i) {
+        pool.submit([&done] { spinWork(20000); done.fetch_add(1); },
+                    useLanes ? Prio::Background : Prio::Normal);
+    }
+
+    const int probes = 200;
+    std::vector<double> waits(probes);
+    std::atomic<long> probed{0};
+    for (int i = 0; i < probes; ++i) {
+        auto t0 = Clock::now();
+        pool.submit([&waits, &probed, t0, i] {
+            waits[i] = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+            probed.fetch_add(1);
+        }, useLanes ? Prio::High : Prio::Normal);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    waitFor(probed, probes);
+    size_t bgLeft = pool.lane_stats(useLanes ? Prio::Background : Prio::Normal).depth;
+    waitFor(done, backlog);
+
+    std::sort(waits.begin(), waits.end());
+    std::cout << std::setw(14) << (useLanes ? "high lane" : "single FIFO") << std::fixed
+              << std::setprecision(0) << std::setw(10) << waits[probes / 2]
+              << std::setw(10) << waits[probes * 99 / 100] << std::setw(14) << bgLeft << "\n";
+}
+
+// ----- Many external producers hammering submit() -----
+static double benchProducers(size_t producers, SimpleThreadPool::Backend backend, bool batched = false) {
+    const long perProducer = 200000 / static_cast<long>(producers);
+    SimpleThreadPool::Options opts;
+    opts.threads = 4;
+    opts.backend = backend;
+    SimpleThreadPool pool(opts);
+    SubmitBatcher batcher(pool);
+    std::atomic<long> done{0};
+
+    auto t0 = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&] {
+            for (long i = 0; i < perProducer; ++i) {
+                if (batched) {
+                    batcher.submit([&done] { done.fetch_add(1); });
+                } else {
+                    pool.submit([&done] { done.fetch_add(1); });
+                }
+            }
+            if (batched) batcher.flush();
+        });
+    }
+    for (auto& t : threads) t.join();
+    waitFor(done, perProducer * static_cast<long>(producers));
+    double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    return perProducer * static_cast<double>(producers) / secs;
+}
+
+// ----- Producers outrunning the workers, bounded queue -----
+// 8 producers submit 1us jobs to 2 workers through a 256-slot queue. Prints
+// how the policy kept memory bounded and what it cost the producers.
+static void benchOverload(SimpleThreadPool::Overflow overflow, const char* name, int iters1us) {
+    SimpleThreadPool::Options opts;
+    opts.threads = 2;
+    opts.queueCapacity = 256;
+    opts.overflow = overflow;
+    SimpleThreadPool pool(opts);
+    const long perProducer = 20000;
+    std::atomic<long> ran{0};
+
+    auto t0 = Clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < 8; ++p) {
+        threads.emplace_back([&] {
+            for (long i = 0; i < perProducer; ++i) {
+                pool.submit([&ran, iters1us] { spinWork(iters1us); ran.fetch_add(1); });
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    pool.wait_idle();
+    double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    auto st = pool.queue_stats();
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(0)
+              << std::setw(12) << ran.load() / secs << std::setw(10) << st.highWater
+              << std::setw(10) << st.blocked << std::setw(10) << st.rejected + st.dropped
+              << std::setw(12) << st.callerRuns << "\n";
+}
+
+// ----- Context switches for bursts of tiny jobs into a parked pool -----
+static long contextSwitches() {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+static void benchWakeups(bool throttle) {
+    SimpleThreadPool::Options opts;
+    opts.threads = 8;
+    opts.idlePolicy = SimpleThreadPool::IdlePolicy::Park;
+    opts.throttleWakeups = throttle;
+    SimpleThreadPool pool(opts);
+
+    const int bursts = 500, perBurst = 32;
+    std::atomic<long> done{0};
+    long csw0 = contextSwitches();
+    auto t0 = Clock::now();
+    for (int b = 0; b < bursts; ++b) {
+        for (int i = 0; i < perBurst; ++i) pool.submit([&done] { spinWork(50); done.fetch_add(1); });
+        waitFor(done, long(b + 1) * perBurst);
+        // Let everyone park again before the next burst.
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+    long jobs = long(bursts) * perBurst;
+    double cswPerK = 1000.0 * static_cast<double>(contextSwitches() - csw0) / static_cast<double>(jobs);
+    std::cout << std::setw(12) << (throttle ? "throttled" : "notify-each") << std::fixed << std::setprecision(0)
+              << std::setw(14) << static_cast<double>(jobs) / secs << std::setprecision(1)
+              << std::setw(16) << cswPerK << "\n";
+}
+
+// ----- fd ping-pong: event-loop thread hopping into the pool vs Options::eventLoop -----
+// The caller writes a byte to a unix socket and blocks on the echo; the pool
+// side reads it in a job and writes it back.
+static void echo(int fd) {
+    char buf[64];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        if (write(fd, buf, static_cast<size_t>(n)) != n) break;
+    }
+}
+
+static void benchFdEvents(bool eventLoop) {
+    SimpleThreadPool::Options opts;
+    opts.threads = 2;
+    opts.eventLoop = eventLoop;
+    SimpleThreadPool pool(opts);
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return;
+    int server = sv[1];
+    fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+
+    // The old way: a thread of its own in epoll_wait, submitting each event.
+    std::atomic<bool> stop{false};
+    std::thread loop;
+    int ep = -1;
+    SimpleThreadPool::WatchHandle watch;
+    if (eventLoop) {
+        watch = pool.watch(server, EPOLLIN, [server](uint32_t) { echo(server); });
+    } else {
+        ep = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.fd = server;
+        epoll_ctl(ep, EPOLL_CTL_ADD, server, &ev);
+        loop = std::thread([&] {
+            epoll_event got;
+            while (!stop.load()) {
+                if (epoll_wait(ep, &got, 1, 50) != 1) continue;
+                pool.submit([&, server] {
+                    echo(server);
+                    epoll_event re{};
+                    re.events = EPOLLIN | EPOLLONESHOT;
+                    re.data.fd = server;
+                    epoll_ctl(ep, EPOLL_CTL_MOD, server, &re);
+                });
+            }
+        });
+    }
+
+    const int trips = 20000;
+    long csw0 = contextSwitches();
+    auto t0 = Clock::now();
+    for (int i = 0; i < trips; ++i) {
+        char c = 'x';
+        if (write(sv[0], &c, 1) != 1 || read(sv[0], &c, 1) != 1) break;
+    }
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / trips;
+    double csw = static_cast<double>(contextSwitches() - csw0) / trips;
+
+    if (eventLoop) {
+        watch.cancel();
+    } else {
+        stop = true;
+        loop.join();
+        close(ep);
+    }
+    pool.wait_idle();
+    close(sv[0]);
+    close(sv[1]);
+    std::cout << std::setw(22) << (eventLoop ? "pool event loop" : "epoll thread + submit") << std::fixed
+              << std::setprecision(1) << std::setw(14) << us << std::setprecision(2) << std::setw(16) << csw
+              << "\n";
+}
+
+// ----- Wake latency for sparse arrivals under each idle policy -----
+// With afterSparse, 200 jobs 1ms apart come first: long enough that Adaptive
+// learns to park straight away, so the rows show whether it learns back.
+static void benchIdle(SimpleThreadPool::IdlePolicy policy, const char* name, bool afterSparse = false) {
+    SimpleThreadPool::Options opts;
+    opts.threads = 2;
+    opts.idlePolicy = policy;
+    SimpleThreadPool pool(opts);
+
+    std::atomic<long> done{0};
+    if (afterSparse) {
+        for (long i = 0; i < 200; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            pool.submit([&done] { done.fetch_add(1); });
+            waitFor(done, i + 1);
+        }
+    }
+
+    const int jobs = 2000;
+    std::vector<double> waits(jobs);
+    long base = done.load();
+    for (int i = 0; i < jobs; ++i) {
+        // Gaps of ~5us: short enough that spinning should catch them.
+        auto until = Clock::now() + std::chrono::microseconds(5);
+        while (Clock::now() < until) {}
+        auto t0 = Clock::now();
+        pool.submit([&waits, &done, t0, i] {
+            waits[i] = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+            done.fetch_add(1);
+        });
+        waitFor(done, base + i + 1);
+    }
+
+    // Then go quiet: a parked pool should use (almost) no CPU.
+    std::clock_t c0 = std::clock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    double idleCpuMs = 1000.0 * static_cast<double>(std::clock() - c0) / CLOCKS_PER_SEC;
+
+    std::sort(waits.begin(), waits.end());
+    std::cout << std::setw(14) << name << std::fixed << std::setprecision(1)
+              << std::setw(10) << waits[jobs / 2] << std::setw(10) << waits[jobs * 99 / 100]
+              << std::setw(16) << idleCpuMs << "\n";
+}
+
+// ----- Tiny jobs from the shared queue: one pop per lock vs batched dequeue -----
+// spinWork iterations that take about `ns` on this machine.
+static int spinItersFor(double ns) {
+    const int probe = 100000;
+    auto t0 = Clock::now();
+    spinWork(probe);
+    double perIter = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / probe;
+    return std::max(1, static_cast<int>(ns / perIter));
+}
+
+static double benchDequeueBatch(size_t threads, size_t batch, int iters) {
+    const int jobs = 200000;
+    const int chunk = 1000;
+    SimpleThreadPool::Options opts;
+    opts.threads = threads;
+    opts.dequeueBatch = batch;
+    SimpleThreadPool pool(opts);
+    std::atomic<long> done{0};
+    std::vector<Task> tasks;
+    tasks.reserve(chunk);
+
+    auto t0 = Clock::now();
+    for (int sent = 0; sent < jobs; sent += chunk) {
+        tasks.clear();
+        for (int i = 0; i < chunk; ++i) {
+            tasks.emplace_back([&done, iters] { spinWork(iters); done.fetch_add(1, std::memory_order_relaxed); });
+        }
+        pool.submit_bulk(tasks);
+    }
+    waitFor(done, jobs);
+    return jobs / std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// ----- Ping-pong: every job hands a message to the next one -----
+// Two chains of jobs, each hop reading and bumping a 16 KiB message, while an
+// outside thread keeps injecting small jobs. Reports ns per hop and how many
+// injected jobs got through, so the fairness cap shows up next to the win.
+static void hop(SimpleThreadPool& pool, std::vector<long>& msg, std::atomic<long>& hops, long left) {
+    long sum = 0;
+    for (long& x : msg) sum += ++x;
+    hops.fetch_add(1, std::memory_order_relaxed);
+    if (left > 0 && sum != 0) pool.submit([&pool, &msg, &hops, left] { hop(pool, msg, hops, left - 1); });
+}
+
+static void benchPingPong(bool workStealing, bool lifo, const char* name) {
+    SimpleThreadPool::Options opts;
+    opts.threads = 4;
+    opts.workStealing = workStealing;
+    opts.lifoSlot = lifo;
+    SimpleThreadPool pool(opts);
+    const long perChain = 20000;
+    std::vector<long> msgA(2048, 1), msgB(2048, 2);
+    std::atomic<long> hops{0}, injected{0};
+    std::atomic<bool> stop{false};
+
+    std::thread injector([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            pool.submit([&injected] { spinWork(200); injected.fetch_add(1, std::memory_order_relaxed); });
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    });
+    auto t0 = Clock::now();
+    pool.submit([&] { hop(pool, msgA, hops, perChain - 1); });
+    pool.submit([&] { hop(pool, msgB, hops, perChain - 1); });
+    waitFor(hops, 2 * perChain);
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / perChain;
+    stop = true;
+    injector.join();
+    pool.wait_idle();
+    std::cout << std::setw(22) << name << std::fixed << std::setprecision(0) << std::setw(12) << ns
+              << std::setw(12) << injected.load() << "\n";
+}
+
+// ----- Elastic pool: bursts, then quiet -----
+static void benchElastic() {
+    SimpleThreadPool::Options opts;
+    opts.threads = 1;
+    opts.elastic = true;
+    opts.maxThreads = 8;
+    opts.keepAlive = std::chrono::milliseconds(50);
+    SimpleThreadPool pool(opts);
+    std::atomic<long> done{0};
+
+    for (int burst = 0; burst < 3; ++burst) {
+        auto t0 = Clock::now();
+        long before = done.load();
+        for (int i = 0; i < 2000; ++i) {
+            pool.submit([&done] { std::this_thread::sleep_for(std::chrono::microseconds(50)); done.fetch_add(1); });
+        }
+        waitFor(done, before + 2000);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        auto busy = pool.elastic_stats();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        auto quiet = pool.elastic_stats();
+        std::cout << "burst " << burst << ": " << std::fixed << std::setprecision(1) << ms
+                  << " ms, live " << busy.live << " -> " << quiet.live << " after quiet, spawned "
+                  << quiet.spawned << ", retired " << quiet.retired << "\n";
+    }
+}
+
+// ----- Cost of recording a trace event per job -----
+// Only built with -DSIMPLE_THREADPOOL_TRACE=1: the same pool with the rings
+// switched off (traceEvents = 0) is the baseline. The worker is held while the
+// jobs are queued, so only its back-to-back run of them is timed.
+#if SIMPLE_THREADPOOL_TRACE
+static double benchTrace(size_t traceEvents) {
+    SimpleThreadPool::Options opts;
+    opts.threads = 1;
+    opts.traceEvents = traceEvents;
+    SimpleThreadPool pool(opts);
+
+    const long jobs = 1 << 20;
+    std::atomic<long> done{0};
+    double best = 1e300;
+    for (int r = 0; r < 5; ++r) {
+        std::atomic<bool> go{false};
+        Clock::time_point t0;
+        pool.submit([&] {
+            while (!go.load()) std::this_thread::yield();
+            t0 = Clock::now();
+        });
+        long before = done.load();
+        for (long i = 0; i < jobs; ++i) pool.submit("bench", [&done] { done.fetch_add(1, std::memory_order_relaxed); });
+        go = true;
+        waitFor(done, before + jobs);
+        best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / jobs);
+    }
+    return best;
+}
+#endif
+
+// ----- Allocations per submit (steady state) -----
+static bool checkAllocations() {
+    SimpleThreadPool::Options opts;
+    opts.threads = 2;
+    opts.workStealing = true;
+    SimpleThreadPool pool(opts);
+
+    std::array<long, 6> payload{};      // 48 bytes of capture: too big for std::function's SBO
+    std::atomic<long> done{0};
+    long sink = 0;
+
+    auto round = [&](int jobs) {
+        long before = done.load();
+        for (int i = 0; i < jobs; ++i) {
+            pool.submit([payload, &done] { done.fetch_add(payload[0] + 1); });
+        }
+        waitFor(done, before + jobs);
+        for (int i = 0; i < jobs; ++i) {
+            auto f = pool.submit_future([payload] { return payload[1] + 1; });
+            sink += f.get();
+        }
+        // Fan-out from inside a worker exercises the per-worker deque path.
+        before = done.load();
+        pool.submit([&pool, &done, &payload, jobs] {
+            for (int i = 0; i < jobs; ++i) {
+                pool.submit([payload, &done] { done.fetch_add(payload[2] + 1); });
+            }
+        });
+        waitFor(done, before + jobs);
+
+        TaskGroup group(pool);
+        for (int i = 0; i < jobs; ++i) group.run([&done] { done.fetch_add(1); });
+        group.wait();
+    };
+
+    const int jobs = 10000;
+    for (int warm = 0; warm < 3; ++warm) {
+        round(jobs);                    // grow queues, job nodes and future freelists
+    }
+    sink = 0;
+    long before = g_allocs.load();
+    round(jobs);
+    long allocs = g_allocs.load() - before;
+
+    std::cout << "allocations for " << 4 * jobs << " submits: " << allocs
+              << (allocs == 0 ? " (ok)" : " (FAIL)") << "\n";
+    return allocs == 0 && sink == jobs;
+}
+
+// ----- Futures dropped without get() -----
+// The producer must be done with a state before it is recycled: dropping one
+// future and reading the next must never see a stale or early-ready state.
+static bool checkDroppedFutures() {
+    SimpleThreadPool pool(2);
+    long bad = 0;
+    for (int i = 0; i < 100000; ++i) {
+        pool.submit_future([i] { return i; });   // dropped at once
+        auto f = pool.submit_future([i] { return i + 1; });
+        if (f.get() != i + 1) ++bad;
+    }
+    pool.wait_idle();
+    std::cout << "dropped futures: " << bad << " bad results" << (bad == 0 ? " (ok)" : " (FAIL)") << "\n";
+    return bad == 0;
+}
+
+// ----- Allocations per strand post from outside the pool (steady state) -----
+// The main thread posts and waits without helping, so every node is drained
+// on a worker and has to find its way back to the posting thread.
+static bool checkStrandAllocations() {
+    SimpleThreadPool pool(2);
+    Strand strand(pool);
+    std::atomic<long> done{0};
+
+    auto round = [&](int posts) {
+        long before = done.load();
+        for (int i = 0; i < posts; ++i) strand.post([&done] { done.fetch_add(1); });
+        waitFor(done, before + posts);
+    };
+
+    const int posts = 10000;
+    round(2 * posts);   // the last node may still be on its way back when a round ends
+    long before = g_allocs.load();
+    round(posts);
+    long allocs = g_allocs.load() - before;
+
+    std::cout << "allocations for " << posts << " strand posts: " << allocs
+              << (allocs == 0 ? " (ok)" : " (FAIL)") << "\n";
+    return allocs == 0;
+}
+
+// ----- SubmitBatcher jobs run in place that submit to the same batcher -----
+// A full CallerRuns queue runs a flushed batch in the flushing thread, so no
+// batcher lock may be held across submit_bulk(); this used to deadlock.
+static bool checkBatcherReentry() {
+    SimpleThreadPool::Options opts;
+    opts.threads = 1;
+    opts.queueCapacity = 4;
+    opts.overflow = SimpleThreadPool::Overflow::CallerRuns;
+    SimpleThreadPool pool(opts);
+    std::atomic<long> done{0};
+    const long jobs = 20000;
+    {
+        SubmitBatcher batcher(pool);
+        for (long i = 0; i < jobs; ++i) {
+            batcher.submit([&batcher, &done] {
+                done.fetch_add(1);
+                batcher.submit([&done] { done.fetch_add(1); });
+            });
+        }
+        batcher.flush();
+        waitFor(done, jobs);
+        batcher.flush_all();   // what the nested submits buffered
+        waitFor(done, 2 * jobs);
+    }
+    std::cout << "batcher re-entry under caller-runs: " << done.load() << " / " << 2 * jobs << " ran (ok)\n";
+    return true;
+}
+
+// ----- wait_idle() racing shutdown() -----
+// A submit (or submit_bulk) refused because the pool is shutting down must
+// still wake a wait_idle() that counted it, or that waiter sleeps forever. A
+// hang cannot be unwound, so it is reported and the process exits.
+static bool checkWaitIdleAcrossShutdown(bool bulk) {
+    const char* name = bulk ? "wait_idle across shutdown, submit_bulk: " : "wait_idle across shutdown, submit: ";
+    const int rounds = 1000;
+    for (int r = 0; r < rounds; ++r) {
+        SimpleThreadPool pool(1);
+        std::atomic<bool> refused{false}, waiterDone{false};
+        std::thread submitter([&] {
+            std::array<Task, 4> jobs;
+            for (;;) {
+                for (auto& j : jobs) j = Task([] {});
+                if (bulk ? pool.submit_bulk(jobs) == 0 : !pool.submit(std::move(jobs[0]))) break;
+            }
+            refused = true;
+        });
+        std::thread waiter([&] {
+            while (!refused) pool.wait_idle();
+            waiterDone = true;
+        });
+        std::this_thread::sleep_for(std::chrono::microseconds(r % 50));
+        pool.shutdown();
+        submitter.join();
+        auto deadline = Clock::now() + std::chrono::seconds(2);
+        while (!waiterDone && Clock::now() < deadline) std::this_thread::yield();
+        if (!waiterDone) {
+            std::cout << name << "hung in round " << r << " (FAIL)" << std::endl;
+            std::_Exit(1);
+        }
+        waiter.join();
+    }
+    std::cout << name << rounds << " rounds (ok)\n";
+    return true;
+}
+
+// ----- outside jobs batched out beside a self-feeding worker -----
+// With batched dequeue, the pop that takes a resubmitting job from the
+// shared lane also moves the outside jobs behind it into the batch buffer.
+// The chain then always has a job on the deque, which popLocal() serves
+// first, so the shared-lane turn must count the batch or they never run.
+static bool checkGlobalTurnFairness() {
+    SimpleThreadPool::Options opts;
+    opts.threads = 1;
+    opts.workStealing = true;
+    opts.dequeueBatch = 16;
+    SimpleThreadPool pool(opts);
+    std::atomic<bool> gate{false}, stop{false};
+    std::atomic<long> outside{0};
+    const long jobs = 8;
+    std::function<void()> chain = [&] {
+        if (!stop.load()) pool.submit(chain);
+    };
+    pool.submit([&] {   // holds the worker until the chain and the jobs are queued together
+        while (!gate.load()) std::this_thread::yield();
+    });
+    pool.submit(chain);
+    for (long i = 0; i < jobs; ++i) pool.submit([&] { outside.fetch_add(1); });
+    gate = true;
+    auto deadline = Clock::now() + std::chrono::seconds(1);
+    while (outside.load() < jobs && Clock::now() < deadline) std::this_thread::yield();
+    long ran = outside.load();
+    stop = true;
+    pool.wait_idle();
+    std::cout << "outside jobs beside a resubmitting chain: " << ran << " / " << jobs
+              << (ran == jobs ? " ran (ok)" : " ran (FAIL)") << "\n";
+    return ran == jobs;
+}
+
+// ----- jobs pushed out of the LIFO slot during shutdown -----
+// A job the slot displaces (lifoLimit reached, or the deque full) moves on
+// to the shared lane. submit() already accepted it, so shutdown() must still
+// run it rather than refuse it there. Chains of self-submitting jobs are cut
+// off by shutdown() at varying points; every accepted job must have run.
+static bool checkLifoShutdown() {
+    long lost = 0;
+    const int rounds = 100;
+    for (int r = 0; r < rounds; ++r) {
+        SimpleThreadPool::Options opts;
+        opts.threads = 2;
+        opts.lifoSlot = true;
+        opts.lifoLimit = 1;
+        opts.workStealing = r & 1;
+        opts.dequeCapacity = 4;
+        if (r & 2) opts.backend = SimpleThreadPool::Backend::LockFree;
+        SimpleThreadPool pool(opts);
+        std::atomic<long> accepted{0}, ran{0};
+        std::function<void(int)> chain = [&](int depth) {
+            ran.fetch_add(1);
+            if (depth == 0) return;
+            for (int k = 0; k < 3; ++k) {
+                if (pool.submit([&chain, depth] { chain(depth - 1); })) accepted.fetch_add(1);
+            }
+        };
+        for (int i = 0; i < 4; ++i) {
+            if (pool.submit([&chain] { chain(6); })) accepted.fetch_add(1);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(r * 7 % 300));
+        pool.shutdown();
+        lost += accepted.load() - ran.load();
+    }
+    std::cout << "jobs lost from the LIFO slot across shutdown: " << lost << " in " << rounds << " rounds"
+              << (lost == 0 ? " (ok)" : " (FAIL)") << "\n";
+    return lost == 0;
+}
+
+// ----- SubmitBatcher thread cache after many short-lived batchers -----
+// Each thread caches its buffer per batcher and scans that cache on every
+// submit; entries of destroyed batchers must be pruned, or a producer that
+// went through many of them pays for all of them on each submit.
+static double batcherSubmitNs(SimpleThreadPool& pool, int deadBatchers) {
+    double ns = 0;
+    std::thread producer([&] {
+        for (int k = 0; k < deadBatchers; ++k) {
+            SubmitBatcher dead(pool);
+            dead.submit([] {});
+        }
+        SubmitBatcher batcher(pool);
+        const int submits = 20000;
+        auto t0 = Clock::now();
+        for (int i = 0; i < submits; ++i) batcher.submit([] {});
+        ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / submits;
+    });
+    producer.join();
+    pool.wait_idle();
+    return ns;
+}
+
+static bool checkBatcherCache() {
+    SimpleThreadPool pool(2);
+    double fresh = batcherSubmitNs(pool, 0);
+    double churned = batcherSubmitNs(pool, 10000);
+    bool ok = churned < 5 * fresh;
+    std::cout << "batcher submit after 10000 dead batchers: " << std::fixed << std::setprecision(0) << churned
+              << " ns vs " << fresh << " ns fresh" << (ok ? " (ok)" : " (FAIL)") << "\n";
+    std::cout.unsetf(std::ios::fixed);
+    return ok;
+}
+
+// ----- SubmitBatcher on a pool that refuses jobs -----
+// Whatever a bounded Reject pool turns away from a flushed batch is counted
+// in rejected(); nothing disappears without a trace.
+static bool checkBatcherRejected() {
+    SimpleThreadPool::Options opts;
+    opts.threads = 1;
+    opts.queueCapacity = 8;
+    opts.overflow = SimpleThreadPool::Overflow::Reject;
+    SimpleThreadPool pool(opts);
+    std::atomic<long> ran{0};
+    const long jobs = 640;
+    uint64_t rejected;
+    {
+        SubmitBatcher batcher(pool);
+        pool.submit([] { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+        for (long i = 0; i < jobs; ++i) batcher.submit([&ran] { ran.fetch_add(1); });
+        batcher.flush();
+        pool.wait_idle();
+        rejected = batcher.rejected();
+    }
+    bool ok = ran.load() + static_cast<long>(rejected) == jobs && rejected > 0;
+    std::cout << "batcher on a full Reject pool: " << ran.load() << " ran + " << rejected << " rejected of " << jobs
+              << (ok ? " (ok)" : " (FAIL)") << "\n";
+    return ok;
+}
+
+int main() {
+    if (!checkAllocations() || !checkDroppedFutures() || !checkStrandAllocations() || !checkBatcherReentry() ||
+        !checkWaitIdleAcrossShutdown(false) || !checkWaitIdleAcrossShutdown(true) || !checkGlobalTurnFairness() ||
+        !checkLifoShutdown() || !checkBatcherCache() || !checkBatcherRejected()) {
+        return 1;
+    }
+
+    CpuTopology topo = CpuTopology::detect();
+    std::cout << "topology:";
+    for (const auto& c : topo.cpus) {
+        std::cout << " cpu" << c.id << "(core " << c.core << ", L2 " << c.l2 << ", L3 " << c.l3
+                  << ", node " << c.node << ")";
+    }
+    std::cout << "\n";
+
+    std::cout << "fan-out tree (jobs/sec), hardware threads = "
+              << std::thread::hardware_concurrency() << "\n";
+    std::cout << std::setw(8) << "threads" << std::setw(16) << "single-queue"
+              << std::setw(16) << "work-stealing" << std::setw(16) << "stealing+pin" << "\n";
+    for (size_t n : {1, 2, 4, 8, 16, 32, 64}) {
+        double shared = benchFanOut(n, false);
+        double stealing = benchFanOut(n, true);
+        double pinned = benchFanOut(n, true, true);
+        std::cout << std::setw(8) << n << std::fixed << std::setprecision(0)
+                  << std::setw(16) << shared << std::setw(16) << stealing
+                  << std::setw(16) << pinned << "\n";
+    }
+
+    std::cout << "\n10k-item batch (us/batch)\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "submit loop"
+              << std::setw(14) << "submit_bulk" << std::setw(14) << "parallel_for" << "\n";
+    for (size_t n : {1, 4, 16}) benchBatch(n);
+
+    std::cout << "\nshort-task wait behind 5000 queued jobs (us)\n";
+    std::cout << std::setw(14) << "mode" << std::setw(10) << "p50" << std::setw(10) << "p99"
+              << std::setw(14) << "backlog left" << "\n";
+    benchPriority(false);
+    benchPriority(true);
+
+    std::cout << "\nexternal producers, 4 workers (jobs/sec)\n";
+    std::cout << std::setw(10) << "producers" << std::setw(14) << "mutex" << std::setw(14) << "lock-free"
+              << std::setw(14) << "batched" << "\n";
+    for (size_t p : {1, 4, 16}) {
+        double locked = benchProducers(p, SimpleThreadPool::Backend::Mutex);
+        double lockFree = benchProducers(p, SimpleThreadPool::Backend::LockFree);
+        double batched = benchProducers(p, SimpleThreadPool::Backend::Mutex, true);
+        std::cout << std::setw(10) << p << std::fixed << std::setprecision(0)
+                  << std::setw(14) << locked << std::setw(14) << lockFree << std::setw(14) << batched << "\n";
+    }
+
+    int iters100ns = spinItersFor(100);
+    std::cout << "\n100ns jobs through the shared queue (jobs/sec)\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "pop 1/lock" << std::setw(14) << "batch 16" << "\n";
+    for (size_t n : {1, 4, 16}) {
+        double single = benchDequeueBatch(n, 1, iters100ns);
+        double batched = benchDequeueBatch(n, 16, iters100ns);
+        std::cout << std::setw(8) << n << std::fixed << std::setprecision(0)
+                  << std::setw(14) << single << std::setw(14) << batched << "\n";
+    }
+
+    std::cout << "\nping-pong, 2 chains x 20000 hops of a 16 KiB message, 4 workers\n";
+    std::cout << std::setw(22) << "mode" << std::setw(12) << "ns/hop" << std::setw(12) << "injected" << "\n";
+    benchPingPong(false, false, "shared FIFO");
+    benchPingPong(false, true, "shared + LIFO slot");
+    benchPingPong(true, false, "stealing");
+    benchPingPong(true, true, "stealing + LIFO slot");
+
+    std::cout << "\n8 producers, 2 workers, 1us jobs, queueCapacity 256\n";
+    std::cout << std::setw(12) << "overflow" << std::setw(12) << "ran/sec" << std::setw(10) << "peak"
+              << std::setw(10) << "blocked" << std::setw(10) << "lost" << std::setw(12) << "caller ran" << "\n";
+    int iters1us = spinItersFor(1000);
+    benchOverload(SimpleThreadPool::Overflow::Block, "block", iters1us);
+    benchOverload(SimpleThreadPool::Overflow::Reject, "reject", iters1us);
+    benchOverload(SimpleThreadPool::Overflow::CallerRuns, "caller-runs", iters1us);
+    benchOverload(SimpleThreadPool::Overflow::DropOldest, "drop-oldest", iters1us);
+
+    std::cout << "\nsubmit-to-start latency, sparse arrivals (us)\n";
+    std::cout << std::setw(14) << "policy" << std::setw(10) << "p50" << std::setw(10) << "p99"
+              << std::setw(16) << "idle cpu ms/200" << "\n";
+    benchIdle(SimpleThreadPool::IdlePolicy::Park, "park");
+    benchIdle(SimpleThreadPool::IdlePolicy::SpinThenPark, "spin-then-park");
+    benchIdle(SimpleThreadPool::IdlePolicy::Adaptive, "adaptive");
+    benchIdle(SimpleThreadPool::IdlePolicy::Adaptive, "after sparse", true);
+
+    std::cout << "\nbursts of 32 tiny jobs into 8 parked workers\n";
+    std::cout << std::setw(12) << "wakeups" << std::setw(14) << "jobs/sec" << std::setw(16) << "csw per 1k jobs"
+              << "\n";
+    benchWakeups(false);
+    benchWakeups(true);
+
+    std::cout << "\nunix socket echo, 2 workers\n";
+    std::cout << std::setw(22) << "fd events" << std::setw(14) << "us/round trip" << std::setw(16)
+              << "csw per trip" << "\n";
+    benchFdEvents(false);
+    benchFdEvents(true);
+
+#if SIMPLE_THREADPOOL_TRACE
+    double untraced = benchTrace(0), traced = benchTrace(1 << 16);
+    std::cout << "\ntracing, 1 worker, empty jobs (ns/job)\n" << std::fixed << std::setprecision(1)
+              << "  rings off " << untraced << ", on " << traced << ", cost " << traced - untraced << "\n";
+#endif
+
+    std::cout << "\nelastic pool, min 1 / max 8, 2000 x 50us sleeping jobs per burst\n";
+    benchElastic();
+    return 0;
+}